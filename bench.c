@@ -0,0 +1,283 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Decoder benchmarks over a made-up stream: throughput of each way of
+ * feeding the decoder, and how long single calls take.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "benchpp.h"
+#include "ccgen.h"
+#include "eia608.h"
+#include "vbi.h"
+
+/* frames each short-lived decoder sees */
+#define LIFETIME 64
+
+/* made-up line 21 waveforms to slice, over and over */
+#define LINES      4096
+#define LINE_WIDTH 720
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long elapsed_ns(const struct timespec* a, const struct timespec* b) {
+    return (b->tv_sec - a->tv_sec) * 1000000000L + (b->tv_nsec - a->tv_nsec);
+}
+
+static int compare_long(const void* a, const void* b) {
+    long x = *(const long*)a, y = *(const long*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* sort the samples and print their percentiles */
+static void percentiles(const char* name, long* ns, long n) {
+    if (n == 0) {
+	printf("%-28s (no samples)\n", name);
+	return;
+    }
+    qsort(ns, n, sizeof(long), compare_long);
+    printf("%-28s %8ld %8ld %8ld %8ld %8ld %9ld\n", name,
+	   ns[n / 2], ns[n * 9 / 10], ns[n * 99 / 100], ns[n * 999 / 1000],
+	   ns[n - 1], n);
+}
+
+static void throughput(const char* name, long pairs, long calls, double secs) {
+    printf("%-28s %12.0f %10.1f\n", name, pairs / secs, secs * 1e9 / calls);
+}
+
+int main(int argc, char** argv) {
+    long nframes = 1000000;
+    unsigned seed = 608;
+    uint8_t* bytes;
+    uint8_t* lines;
+    uint8_t pair[2];
+    void* arena;
+    ccgen_t* gen;
+    eia608_t* decoder;
+    eia608_multi_t* multi;
+    benchpp_t pp;
+    struct timespec t0, t1;
+    long *input_ns, *row_ns, *utf8_ns, *screen_ns;
+    long clock_ns[1000];
+    long i, j, padding = 0, changes = 0, nlines, wrong = 0;
+    double start, secs;
+    int opt, row;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+	switch (opt) {
+	case 'n':
+	    nframes = atol(optarg);
+	    break;
+	case 's':
+	    seed = atoi(optarg);
+	    break;
+	default:
+	    fprintf(stderr, "usage: %s [-n frames] [-s seed]\n", argv[0]);
+	    return 1;
+	}
+    }
+    if (nframes <= 0) {
+	fprintf(stderr, "%s: need some frames\n", argv[0]);
+	return 1;
+    }
+
+    bytes = malloc(4 * nframes);
+    arena = aligned_alloc(eia608_alignof(), eia608_sizeof());
+    input_ns = malloc(nframes * sizeof(long));
+    row_ns = malloc(nframes * sizeof(long));
+    utf8_ns = malloc(nframes * sizeof(long));
+    screen_ns = malloc(nframes * sizeof(long));
+    lines = malloc(LINES * LINE_WIDTH);
+    if (!bytes || !arena || !input_ns || !row_ns || !utf8_ns || !screen_ns || !lines) {
+	perror("malloc");
+	return 1;
+    }
+
+    gen = ccgen_new(seed);
+    ccgen_fill(gen, bytes, nframes);
+    ccgen_free(gen);
+    for (i = 0; i < nframes; ++i) {
+	if (bytes[4*i] == 0x80 && bytes[4*i+1] == 0x80)
+	    padding++;
+    }
+    printf("%ld frames, seed %u, %.1f%% padding in field 1\n\n",
+	   nframes, seed, 100.0 * padding / nframes);
+
+    /* throughput; the CC1 decoders see one pair a frame, the multi-service
+       decoder both */
+    printf("%-28s %12s %10s\n", "throughput", "pairs/s", "ns/call");
+
+    decoder = eia608_new();
+    start = now();
+    for (i = 0; i < nframes; ++i) {
+	eia608_input(decoder, bytes + 4*i);
+    }
+    throughput("eia608_input", nframes, nframes, now() - start);
+    eia608_free(decoder);
+
+    decoder = eia608_new();
+    start = now();
+    for (i = 0; i < nframes; i += 1024) {
+	eia608_input_batch(decoder, bytes + 4*i, nframes - i < 1024 ? nframes - i : 1024);
+    }
+    throughput("eia608_input_batch (1024)", nframes, (nframes + 1023) / 1024, now() - start);
+    eia608_free(decoder);
+
+    multi = eia608_multi_new();
+    start = now();
+    for (i = 0; i < nframes; ++i) {
+	eia608_multi_input(multi, bytes + 4*i);
+    }
+    throughput("eia608_multi_input", 2 * nframes, nframes, now() - start);
+    eia608_multi_free(multi);
+
+    multi = eia608_multi_new();
+    start = now();
+    for (i = 0; i < nframes; i += 1024) {
+	eia608_multi_input_batch(multi, bytes + 4*i, nframes - i < 1024 ? nframes - i : 1024);
+    }
+    throughput("eia608_multi_input_batch", 2 * nframes, (nframes + 1023) / 1024, now() - start);
+    eia608_multi_free(multi);
+
+    /* the C++ template decoder for CC1 alone, fed a pair at a time, and
+       the C decoder with the same events going to a handler */
+    benchpp_run(bytes, nframes, &pp);
+    throughput("eia608::decoder<CC1>", nframes, nframes, pp.secs);
+    throughput("  with an event sink", nframes, nframes, pp.sink_secs);
+    throughput("eia608_input with a handler", nframes, nframes, pp.c_secs);
+    printf("%-28s %12ld of %ld\n", "events unlike eia608.c's", pp.differ, pp.events);
+
+    /* decoders that each only see a short stretch of the stream, made
+       afresh for every stretch or reused */
+    printf("\n%-28s %12s %10s\n", "short-lived decoders", "decoders/s", "ns each");
+
+    start = now();
+    for (i = 0; i + LIFETIME <= nframes; i += LIFETIME) {
+	decoder = eia608_new();
+	eia608_input_batch(decoder, bytes + 4*i, LIFETIME);
+	eia608_free(decoder);
+    }
+    throughput("eia608_new/free", nframes / LIFETIME, nframes / LIFETIME, now() - start);
+
+    decoder = eia608_init(arena);
+    start = now();
+    for (i = 0; i + LIFETIME <= nframes; i += LIFETIME) {
+	eia608_reset(decoder);
+	eia608_input_batch(decoder, bytes + 4*i, LIFETIME);
+    }
+    throughput("eia608_reset", nframes / LIFETIME, nframes / LIFETIME, now() - start);
+    eia608_fini(decoder);
+
+    /* slicing the pairs back out of made-up line 21 waveforms, both
+       fields of each frame, so 59.94 lines a second of SD video */
+    gen = ccgen_new(seed);
+    for (i = 0; i < LINES; ++i) {
+	ccgen_line21(gen, bytes + 2 * (i % (2 * nframes)), lines + LINE_WIDTH * i, LINE_WIDTH);
+    }
+    ccgen_free(gen);
+    nlines = 2 * nframes < 200000 ? 2 * nframes : 200000;
+
+    start = now();
+    for (i = 0; i < nlines; ++i) {
+	j = i % LINES;
+	if (!vbi_slice(lines + LINE_WIDTH * j, LINE_WIDTH, pair) ||
+	    memcmp(pair, bytes + 2 * (j % (2 * nframes)), 2) != 0)
+	    wrong++;
+    }
+    secs = now() - start;
+
+    printf("\n%-28s %12s %10s\n", "line 21", "lines/s", "ns/line");
+    throughput("vbi_slice (720 wide)", nlines, nlines, secs);
+    printf("%-28s %12.0f\n", "SD streams a core", nlines / secs / 59.94);
+    printf("%-28s %12ld\n", "lines missed or misread", wrong);
+
+    /* latency of single calls, and of getting the screen whenever it has
+       changed, which is when a player would */
+    decoder = eia608_new();
+    for (i = 0; i < nframes; ++i) {
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	eia608_input(decoder, bytes + 4*i);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	input_ns[i] = elapsed_ns(&t0, &t1);
+
+	if (!eia608_get_changed_rows(decoder))
+	    continue;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (row = 0; row < EIA608_ROWS; ++row) {
+	    eia608_get_row(decoder, row);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	row_ns[changes] = elapsed_ns(&t0, &t1);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (row = 0; row < EIA608_ROWS; ++row) {
+	    eia608_get_row_utf8(decoder, row, NULL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	utf8_ns[changes] = elapsed_ns(&t0, &t1);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	eia608_get_screen(decoder);
+	eia608_get_attributes(decoder);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	screen_ns[changes] = elapsed_ns(&t0, &t1);
+
+	changes++;
+    }
+    eia608_free(decoder);
+
+    /* what the clock itself costs */
+    for (i = 0; i < 1000; ++i) {
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	clock_ns[i] = elapsed_ns(&t0, &t1);
+    }
+
+    printf("\n%-28s %8s %8s %8s %8s %8s %9s\n", "latency (ns)",
+	   "p50", "p90", "p99", "p99.9", "max", "samples");
+    percentiles("clock_gettime", clock_ns, 1000);
+    percentiles("eia608_input", input_ns, nframes);
+    percentiles("eia608_get_row (all rows)", row_ns, changes);
+    percentiles("eia608_get_row_utf8 (all)", utf8_ns, changes);
+    percentiles("eia608_get_screen", screen_ns, changes);
+
+    free(bytes);
+    free(arena);
+    free(input_ns);
+    free(row_ns);
+    free(utf8_ns);
+    free(screen_ns);
+    free(lines);
+    return 0;
+}
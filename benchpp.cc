@@ -0,0 +1,157 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * The part of the benchmarks that's C++: the template decoder against
+ * the C one it was made from.
+ */
+
+#include <cstdlib>
+#include <ctime>
+
+#include "benchpp.h"
+#include "eia608.hpp"
+
+static double now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* an FNV-1a hash of everything in an event */
+static uint64_t hash_event(int type, long frame, int mode, int row,
+			   const eia608_cell_t* cells) {
+    uint64_t h = 14695981039346656037ULL;
+    long v[4] = {type, frame, mode, row};
+    const uint8_t* p = (const uint8_t*)v;
+    size_t i;
+
+    for (i = 0; i < sizeof(v); ++i) {
+	h = (h ^ p[i]) * 1099511628211ULL;
+    }
+    p = (const uint8_t*)cells;
+    for (i = 0; cells && i < sizeof(eia608_cell_t) * EIA608_COLUMNS; ++i) {
+	h = (h ^ p[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+/* the events of the C decoder, as hashes */
+struct recording {
+    uint64_t* hashes;
+    long n, size;
+};
+
+static void record(void* data, const eia608_event_t* e) {
+    recording* r = (recording*)data;
+
+    if (r->n == r->size) {
+	r->size = r->size ? 2 * r->size : 1024;
+	r->hashes = (uint64_t*)realloc(r->hashes, r->size * sizeof(uint64_t));
+    }
+    r->hashes[r->n++] = hash_event(e->type, e->frame, e->mode, e->row, e->cells);
+}
+
+/* a sink that checks each event against the recording */
+struct checker {
+    const recording* r;
+    long n, differ;
+
+    void operator()(const eia608::event<eia608_cell_t>& e) {
+	if (n >= r->n || r->hashes[n] != hash_event(e.type, e.frame, e.mode, e.row, e.cells))
+	    differ++;
+	n++;
+    }
+};
+
+/* a sink, and a handler, that only count */
+struct counter {
+    long n;
+
+    void operator()(const eia608::event<eia608_cell_t>&) {
+	n++;
+    }
+};
+
+static void count(void* data, const eia608_event_t*) {
+    ++*(long*)data;
+}
+
+/* run one service through both decoders; adds to the events compared
+   and the ones that differ */
+template <int Service>
+static void check(const uint8_t* bytes, long nframes, benchpp_t* result) {
+    recording r = {NULL, 0, 0};
+    eia608_t* c = eia608_new();
+    eia608::decoder<Service, eia608_cell_t, checker>* d;
+    long i;
+
+    eia608_set_wanted(c, Service);
+    eia608_set_event_handler(c, record, &r);
+    eia608_input_batch(c, bytes, nframes);
+    eia608_free(c);
+
+    d = new eia608::decoder<Service, eia608_cell_t, checker>(checker{&r, 0, 0});
+    for (i = 0; i < nframes; ++i) {
+	d->input(bytes + 4*i);
+    }
+    result->events += r.n;
+    result->differ += d->sink().differ + (d->sink().n < r.n ? r.n - d->sink().n : 0);
+    delete d;
+    free(r.hashes);
+}
+
+void benchpp_run(const uint8_t* bytes, long nframes, benchpp_t* result) {
+    eia608::decoder<EIA608_CC1>* plain = new eia608::decoder<EIA608_CC1>();
+    eia608::decoder<EIA608_CC1, eia608_cell_t, counter>* sinking =
+	new eia608::decoder<EIA608_CC1, eia608_cell_t, counter>(counter{0});
+    eia608_t* c = eia608_new();
+    long i, events = 0;
+    double start;
+
+    /* the way a caller that splits the fields itself would */
+    start = now();
+    for (i = 0; i < nframes; ++i) {
+	plain->input_pair(bytes[4*i], bytes[4*i + 1]);
+    }
+    result->secs = now() - start;
+
+    start = now();
+    for (i = 0; i < nframes; ++i) {
+	sinking->input_pair(bytes[4*i], bytes[4*i + 1]);
+    }
+    result->sink_secs = now() - start;
+
+    eia608_set_event_handler(c, count, &events);
+    start = now();
+    for (i = 0; i < nframes; ++i) {
+	eia608_input(c, bytes + 4*i);
+    }
+    result->c_secs = now() - start;
+
+    delete plain;
+    delete sinking;
+    eia608_free(c);
+
+    result->events = result->differ = 0;
+    check<EIA608_CC1>(bytes, nframes, result);
+    check<EIA608_CC3>(bytes, nframes, result);
+    check<EIA608_TEXT1>(bytes, nframes, result);
+}
@@ -0,0 +1,46 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __BENCHPP_H
+#define __BENCHPP_H
+
+#include <inttypes.h>
+
+/* how the template decoder of eia608.hpp did on a stream */
+typedef struct {
+    double secs;        /* CC1 pair by pair, nobody listening */
+    double sink_secs;   /* CC1 pair by pair, counting events */
+    double c_secs;      /* eia608_input, counting events with a handler */
+    long events;        /* events of CC1, CC3 and TEXT1 compared */
+    long differ;        /* of those, the ones unlike eia608.c's or missing */
+} benchpp_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* time the template decoder on nframes frames of bytes, and check that it
+   sends the same events as the C one */
+void benchpp_run(const uint8_t* bytes, long nframes, benchpp_t* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ndef __BENCHPP_H */
@@ -0,0 +1,128 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Finds every place a phrase was said in a caption index made by
+ * tst -x, and prints the file, the service and the timecode of each.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ccindex.h"
+#include "eia608.h"
+#include "smpte.h"
+
+/* whether to drop frames in 29.97 and 59.94 timecodes */
+static int dropframe = 1;
+
+static void print_hit(void* data, const ccindex_hit_t* hit) {
+    char tc[SMPTE_STR_LEN];
+    smpte_t smpte;
+
+    if (data)
+	return;
+    if (smpte_init_rate(&smpte, dropframe, hit->rate_num, hit->rate_den) == 0) {
+	smpte_set_frame(&smpte, hit->frame);
+	smpte_format(&smpte, tc);
+    } else {
+	snprintf(tc, sizeof(tc), "%ld", hit->frame);
+    }
+    printf("%s\t%s\t%s\n", hit->name, eia608_service_name(hit->service), tc);
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+	    "usage: %s [-c] [-n] [-v] index word...\n"
+	    "  finds every place the words were said one after the other\n"
+	    "  -c  just count the places\n"
+	    "  -n  give 29.97 and 59.94 timecodes without dropping frames\n"
+	    "  -v  say how big the index is and how long the search took\n",
+	    prog);
+}
+
+int main(int argc, char** argv) {
+    ccindex_t* index;
+    const char* error;
+    char* phrase;
+    size_t len = 0;
+    struct timespec t0, t1;
+    int counting = 0, verbose = 0;
+    int opt, i;
+    long hits;
+
+    while ((opt = getopt(argc, argv, "cnv")) != -1) {
+	switch (opt) {
+	case 'c':
+	    counting = 1;
+	    break;
+	case 'n':
+	    dropframe = 0;
+	    break;
+	case 'v':
+	    verbose = 1;
+	    break;
+	default:
+	    usage(argv[0]);
+	    return 1;
+	}
+    }
+    if (argc - optind < 2) {
+	usage(argv[0]);
+	return 1;
+    }
+
+    /* the words can come as one argument or several */
+    for (i = optind + 1; i < argc; ++i) {
+	len += strlen(argv[i]) + 1;
+    }
+    phrase = malloc(len);
+    phrase[0] = '\0';
+    for (i = optind + 1; i < argc; ++i) {
+	if (i > optind + 1)
+	    strcat(phrase, " ");
+	strcat(phrase, argv[i]);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    index = ccindex_open(argv[optind], &error);
+    if (!index) {
+	fprintf(stderr, "%s: %s\n", argv[optind], error);
+	free(phrase);
+	return 1;
+    }
+    hits = ccindex_find(index, phrase, print_hit, counting ? &counting : NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    if (hits < 0)
+	fprintf(stderr, "no words to look for in \"%s\"\n", phrase);
+    else if (counting)
+	printf("%ld\n", hits);
+    if (verbose)
+	fprintf(stderr, "%ld files in %d segments; %ld places in %.3f ms\n",
+		ccindex_files(index), ccindex_segments(index), hits < 0 ? 0 : hits,
+		(t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+
+    ccindex_close(index);
+    free(phrase);
+    return hits < 0;
+}
@@ -0,0 +1,274 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ccgen.h"
+#include "eia608.h"
+
+/* the longest caption that gets queued at once, in pairs */
+#define QUEUE_SIZE 1024
+
+/* one field's worth of pairs waiting to go out */
+typedef struct {
+    uint8_t pairs[QUEUE_SIZE][2];
+    int head, tail;
+    int rollup; /* rows in the current roll-up window, 0 if none */
+    int cc3;    /* field 2, so only ever CC3 */
+} queue_t;
+
+struct __ccgen_struct {
+    uint32_t state;
+    queue_t field[2];
+};
+
+/* PAC first bytes and whether the row is the second one for it, by row */
+static const uint8_t pac_b1[EIA608_ROWS] = {
+    0x11, 0x11, 0x12, 0x12, 0x15, 0x15, 0x16, 0x16,
+    0x17, 0x17, 0x10, 0x13, 0x13, 0x14, 0x14
+};
+static const uint8_t pac_next[EIA608_ROWS] = {
+    0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 0, 1, 0, 1
+};
+
+static const char* words[] = {
+    "THE", "CAPTION", "DECODER", "IS", "WORKING", "AGAIN", "TONIGHT",
+    "WEATHER", "NEWS", "AT", "ELEVEN", "[MUSIC]", "(LAUGHTER)", ">>",
+    "WE'LL", "BE", "RIGHT", "BACK", "AFTER", "THIS", "--", "OKAY?",
+    "Mixed", "case", "text", "and", "numbers", "1,234", "$5.99"
+};
+#define NWORDS (sizeof(words) / sizeof(words[0]))
+
+/* xorshift; plenty for making up captions */
+static uint32_t next(ccgen_t* gen) {
+    uint32_t x = gen->state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return gen->state = x;
+}
+
+static int chance(ccgen_t* gen, int n) {
+    return next(gen) % n;
+}
+
+static uint8_t parity(uint8_t b) {
+    uint8_t bits = b ^ (b >> 4);
+
+    bits ^= bits >> 2;
+    bits ^= bits >> 1;
+    return (bits & 1) ? b : b | 0x80;
+}
+
+static void push(queue_t* q, uint8_t b1, uint8_t b2) {
+    if ((q->tail + 1) % QUEUE_SIZE == q->head)
+	return;
+    q->pairs[q->tail][0] = b1;
+    q->pairs[q->tail][1] = b2;
+    q->tail = (q->tail + 1) % QUEUE_SIZE;
+}
+
+/* control codes always go out twice */
+static void control(queue_t* q, uint8_t b1, uint8_t b2) {
+    push(q, b1, b2);
+    push(q, b1, b2);
+}
+
+static void pac(ccgen_t* gen, queue_t* q, int row) {
+    uint8_t b2 = 0x40 | (pac_next[row] << 5);
+
+    if (chance(gen, 3))
+	b2 |= 0x10 | (chance(gen, 8) << 1); /* indent */
+    else
+	b2 |= chance(gen, 8) << 1;          /* color or italics */
+    b2 |= chance(gen, 4) == 0;              /* underline */
+    control(q, pac_b1[row], b2);
+}
+
+/* a line of words, a pair at a time, with a mid-row attribute, a tab or
+   an extended character thrown in now and then */
+static void text(ccgen_t* gen, queue_t* q, int max) {
+    char line[64];
+    int len = 0, n, i;
+
+    while (len < max) {
+	const char* w = words[chance(gen, NWORDS)];
+	n = strlen(w);
+	if (len + n + 1 > max)
+	    break;
+	memcpy(line + len, w, n);
+	len += n;
+	line[len++] = ' ';
+    }
+    if (len == 0)
+	return;
+    len--;
+
+    for (i = 0; i < len; i += 2) {
+	switch (chance(gen, 24)) {
+	case 0:
+	    control(q, 0x11, 0x20 | chance(gen, 16)); /* mid-row */
+	    break;
+	case 1:
+	    control(q, 0x17, 0x21 + chance(gen, 3));  /* tab offset */
+	    break;
+	case 2:
+	    control(q, 0x11, 0x30 + chance(gen, 16)); /* special */
+	    break;
+	case 3:
+	    /* extended characters replace the basic one sent before */
+	    push(q, 'E', 0x00);
+	    control(q, 0x12 + chance(gen, 2), 0x20 + chance(gen, 32));
+	    break;
+	}
+	push(q, line[i], i + 1 < len ? line[i + 1] : 0x00);
+    }
+}
+
+/* queue one caption, in a style picked at random */
+static void caption(ccgen_t* gen, queue_t* q) {
+    int rows, row, i;
+
+    /* CC3 only does pop-on and roll-up */
+    switch (q->cc3 ? chance(gen, 2) * 2 : chance(gen, 5)) {
+    case 0: /* pop-on */
+	q->rollup = 0;
+	control(q, 0x14, 0x20);                         /* RCL */
+	control(q, 0x14, 0x2E);                         /* ENM */
+	rows = 1 + chance(gen, 3);
+	row = 14 - rows - chance(gen, 8);
+	for (i = 0; i < rows; ++i) {
+	    pac(gen, q, row + i);
+	    text(gen, q, 32);
+	}
+	control(q, 0x14, 0x2F);                         /* EOC */
+	break;
+    case 1: /* paint-on */
+	q->rollup = 0;
+	control(q, 0x14, 0x29);                         /* RDC */
+	pac(gen, q, chance(gen, 15));
+	text(gen, q, 32);
+	break;
+    case 2: /* roll-up */
+	if (!q->rollup || chance(gen, 8) == 0) {
+	    q->rollup = 2 + chance(gen, 3);
+	    control(q, 0x14, 0x25 + q->rollup - 2);     /* RU2-RU4 */
+	    pac(gen, q, 14);
+	}
+	control(q, 0x14, 0x2D);                         /* CR */
+	text(gen, q, 32);
+	break;
+    case 3: /* text mode */
+	q->rollup = 0;
+	control(q, 0x14, chance(gen, 2) ? 0x2A : 0x2B); /* TR, RTD */
+	text(gen, q, 32);
+	control(q, 0x14, 0x2D);                         /* CR */
+	break;
+    case 4: /* clear */
+	q->rollup = 0;
+	control(q, 0x14, 0x2C);                         /* EDM */
+	break;
+    }
+}
+
+ccgen_t* ccgen_new(unsigned seed) {
+    ccgen_t* gen = malloc(sizeof(ccgen_t));
+
+    if (!gen)
+	return NULL;
+    memset(gen, 0, sizeof(ccgen_t));
+    gen->state = seed ? seed : 1;
+    gen->field[1].cc3 = 1;
+
+    return gen;
+}
+
+void ccgen_free(ccgen_t* gen) {
+    free(gen);
+}
+
+static void fill_pair(ccgen_t* gen, queue_t* q, uint8_t* pair) {
+    if (q->head == q->tail) {
+	/* between captions, mostly nothing */
+	if (chance(gen, q->cc3 ? 600 : 120) != 0) {
+	    pair[0] = pair[1] = 0x80;
+	    return;
+	}
+	caption(gen, q);
+    }
+
+    pair[0] = parity(q->pairs[q->head][0]);
+    pair[1] = parity(q->pairs[q->head][1]);
+    q->head = (q->head + 1) % QUEUE_SIZE;
+
+    /* and now and then a bit gets flipped on the way */
+    if (chance(gen, 500) == 0)
+	pair[chance(gen, 2)] ^= 1 << chance(gen, 8);
+}
+
+void ccgen_fill(ccgen_t* gen, uint8_t* bytes, size_t nframes) {
+    size_t i;
+
+    for (i = 0; i < nframes; ++i) {
+	fill_pair(gen, &gen->field[0], bytes + 4*i);
+	fill_pair(gen, &gen->field[1], bytes + 4*i + 2);
+    }
+}
+
+/* the waveform's levels in 8-bit luma: blanking, and 50 IRE above it */
+#define LINE21_LOW  16
+#define LINE21_HIGH 126
+
+void ccgen_line21(ccgen_t* gen, const uint8_t pair[2], uint8_t* luma, int width) {
+    double ideal[width];
+    double bit = width * 26.81 / 720;                  /* samples a bit */
+    double start = width * 20.0 / 720 + chance(gen, 5) - 2;
+    double gain = 0.7 + chance(gen, 40) / 100.0;
+    double t, v;
+    unsigned word = (pair[1] << 8) | pair[0];
+    int i, cell;
+
+    /* seven cycles of run-in, two zero bits, the start bit, two bytes */
+    for (i = 0; i < width; ++i) {
+	t = (i - start) / bit;
+	cell = (int)floor(t);
+	if (cell < 0 || cell >= 26)
+	    v = 0;
+	else if (cell < 7)
+	    v = (1 - cos(2 * M_PI * t)) / 2;
+	else if (cell < 9)
+	    v = 0;
+	else if (cell == 9)
+	    v = 1;
+	else
+	    v = (word >> (cell - 10)) & 1;
+	ideal[i] = v;
+    }
+
+    /* a tape doesn't keep the edges sharp or the levels where they were */
+    for (i = 0; i < width; ++i) {
+	v = (ideal[i > 1 ? i - 2 : 0] + 2 * ideal[i > 0 ? i - 1 : 0] + 3 * ideal[i] +
+	     2 * ideal[i + 1 < width ? i + 1 : i] + ideal[i + 2 < width ? i + 2 : i]) / 9;
+	v = LINE21_LOW + v * gain * (LINE21_HIGH - LINE21_LOW) + chance(gen, 17) - 8;
+	luma[i] = v < 0 ? 0 : v > 255 ? 255 : (uint8_t)v;
+    }
+}
@@ -0,0 +1,44 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __CCGEN_H
+#define __CCGEN_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/* makes up a plausible stream of caption data: pop-on, roll-up (2, 3
+   and 4 rows), paint-on and text mode captions with attributes, tabs and
+   extended characters, every control code doubled, long stretches of
+   padding in between, and the odd parity error.  CC1 and TEXT1 are in
+   field 1 and CC3 in field 2.  the same seed always gives the same
+   stream. */
+typedef struct __ccgen_struct ccgen_t;
+
+ccgen_t* ccgen_new(unsigned seed);
+void ccgen_free(ccgen_t* gen);
+
+/* write the next nframes four-byte frames to bytes */
+void ccgen_fill(ccgen_t* gen, uint8_t* bytes, size_t nframes);
+
+/* draw the line-21 waveform carrying pair into width 8-bit luma
+   samples, blurred, faded and noisy, and a little early or late */
+void ccgen_line21(ccgen_t* gen, const uint8_t pair[2], uint8_t* luma, int width);
+
+#endif /* ndef __CCGEN_H */
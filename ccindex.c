@@ -0,0 +1,945 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * A segment, all numbers little-endian and every part starting on an
+ * eight-byte boundary:
+ *
+ *   header    "CCIX", version, size of the whole segment, number of files
+ *             and of terms, and where the files, terms, postings and
+ *             strings start, from the start of the segment
+ *   files     16 bytes each: name (in the strings), service, rate_num
+ *             and rate_den
+ *   terms     24 bytes each, in byte order of their words: word (in the
+ *             strings), its length, where its postings start (in the
+ *             postings), how many bytes of them and how many there are
+ *   postings  for each term, its (file, word number, frame)s in order,
+ *             as varints: the file, less the one before (the first one,
+ *             counting from -1); then if that's 0 the word number and the
+ *             frame less the ones before, the frame zigzagged, and if not,
+ *             the word number and frame themselves
+ *   strings   the file names, NUL-terminated, and the words
+ *
+ * Words are numbered from 0 through the captions of each file.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ccindex.h"
+
+#define MAGIC          "CCIX"
+#define VERSION        1
+#define HEADER_SIZE    64
+#define FILE_SIZE      16
+#define TERM_SIZE      24
+
+/* a segment is written once the postings in memory get this big */
+#define SEGMENT_BYTES  (64 << 20)
+
+/* the most words of a phrase that are looked for */
+#define PHRASE_MAX     16
+
+/* splitting text into words */
+
+typedef void (*word_fn)(void* data, const char* word, int len);
+
+/* the next character of UTF-8 text, moving on past it */
+static unsigned next_char(const char** text) {
+    const unsigned char* p = (const unsigned char*)*text;
+    unsigned c = *p++;
+    int more = 0;
+
+    if (c >= 0xF0) {
+	c &= 0x07;
+	more = 3;
+    } else if (c >= 0xE0) {
+	c &= 0x0F;
+	more = 2;
+    } else if (c >= 0xC0) {
+	c &= 0x1F;
+	more = 1;
+    }
+    for (; more > 0 && (*p & 0xC0) == 0x80; --more) {
+	c = (c << 6) | (*p++ & 0x3F);
+    }
+    *text = (const char*)p;
+    return more ? 0xFFFD : c;
+}
+
+/* a character as it goes in a word, in lower case, or 0 if it's not one
+   that words are made of.  the captions' accented letters are all in
+   Latin-1. */
+static unsigned word_char(unsigned c) {
+    if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
+	return c;
+    if (c >= 'A' && c <= 'Z')
+	return c + 0x20;
+    if (c >= 0xC0 && c <= 0xDE && c != 0xD7)
+	return c + 0x20;
+    if (c >= 0xDF && c <= 0xFF && c != 0xF7)
+	return c;
+    return 0;
+}
+
+/* call fn with each word of text.  an apostrophe, straight or curly, is
+   kept inside a word, as in "we'll".  returns how many words there were. */
+static int split_words(const char* text, word_fn fn, void* data) {
+    char word[CCINDEX_WORD_MAX + 4];
+    int len = 0, count = 0;
+    const char* peek;
+    unsigned c, w;
+
+    while (*text) {
+	c = next_char(&text);
+	w = word_char(c);
+	if (!w && len > 0 && (c == '\'' || c == 0x2019)) {
+	    peek = text;
+	    if (*peek && word_char(next_char(&peek)))
+		w = '\'';
+	}
+	if (w) {
+	    if (w < 0x80 && len < CCINDEX_WORD_MAX) {
+		word[len++] = w;
+	    } else if (w >= 0x80 && len + 1 < CCINDEX_WORD_MAX) {
+		word[len++] = 0xC0 | (w >> 6);
+		word[len++] = 0x80 | (w & 0x3F);
+	    }
+	    continue;
+	}
+	if (len > 0) {
+	    fn(data, word, len);
+	    count++;
+	    len = 0;
+	}
+    }
+    if (len > 0) {
+	fn(data, word, len);
+	count++;
+    }
+    return count;
+}
+
+/* one file's words */
+
+struct __ccindex_doc_struct {
+    char* name;
+    int service, rate_num, rate_den;
+    int failed;
+
+    /* the words so far, each as the frame it was on (4 bytes), its length
+       (1) and itself */
+    uint8_t* words;
+    size_t len, size;
+
+    /* the caption on screen, and the one it replaced or scrolled from */
+    int open, rolling;
+    long start, ended;
+    char rows[EIA608_ROWS][EIA608_UTF8_ROW_MAX + 1];
+    char before[EIA608_ROWS][EIA608_UTF8_ROW_MAX + 1];
+};
+
+ccindex_doc_t* ccindex_doc_new(const char* name, int service, int num, int den) {
+    ccindex_doc_t* doc = calloc(1, sizeof(ccindex_doc_t));
+
+    if (!doc)
+	return NULL;
+    doc->name = strdup(name);
+    doc->service = service;
+    doc->rate_num = num;
+    doc->rate_den = den;
+    doc->ended = -1;
+    return doc;
+}
+
+void ccindex_doc_free(ccindex_doc_t* doc) {
+    free(doc->name);
+    free(doc->words);
+    free(doc);
+}
+
+static void add_word(void* data, const char* word, int len) {
+    ccindex_doc_t* doc = (ccindex_doc_t*)data;
+    uint32_t frame = doc->start;
+    uint8_t* grown;
+
+    if (doc->len + 5 + len > doc->size) {
+	grown = realloc(doc->words, doc->size ? 2 * doc->size : 4096);
+	if (!grown) {
+	    doc->failed = 1;
+	    return;
+	}
+	doc->words = grown;
+	doc->size = doc->size ? 2 * doc->size : 4096;
+    }
+    memcpy(doc->words + doc->len, &frame, 4);
+    doc->words[doc->len + 4] = len;
+    memcpy(doc->words + doc->len + 5, word, len);
+    doc->len += 5 + len;
+}
+
+/* take the words of the caption that's just gone.  when roll-up or text
+   scrolls, each row that was already there has moved up one, and only
+   the rest are new. */
+static void end_caption(ccindex_doc_t* doc, long end) {
+    int i;
+
+    if (!doc->open)
+	return;
+    doc->open = 0;
+    doc->ended = end;
+
+    for (i = 0; i < EIA608_ROWS; ++i) {
+	if (doc->rolling && i + 1 < EIA608_ROWS && doc->rows[i][0] &&
+	    strcmp(doc->rows[i], doc->before[i + 1]) == 0)
+	    continue;
+	split_words(doc->rows[i], add_word, doc);
+    }
+    memcpy(doc->before, doc->rows, sizeof(doc->rows));
+}
+
+void ccindex_event(void* data, const eia608_event_t* event) {
+    ccindex_doc_t* doc = (ccindex_doc_t*)data;
+
+    switch (event->type) {
+    case EIA608_EVENT_CUE_START:
+	end_caption(doc, event->frame);
+	/* only a caption that takes over from another at once scrolled
+	   from it; after an erase, everything is new */
+	if (doc->ended != event->frame)
+	    memset(doc->before, 0, sizeof(doc->before));
+	memset(doc->rows, 0, sizeof(doc->rows));
+	doc->open = 1;
+	doc->rolling = (event->mode == EIA608_MODE_ROLLUP || event->mode == EIA608_MODE_TEXT);
+	doc->start = event->frame;
+	break;
+
+    case EIA608_EVENT_CUE_END:
+	end_caption(doc, event->frame);
+	break;
+
+    case EIA608_EVENT_ROW:
+	eia608_row_to_utf8(event->cells, doc->rows[event->row]);
+	break;
+    }
+}
+
+/* building segments */
+
+typedef struct {
+    uint32_t word;     /* where its bytes are in the writer's words */
+    uint32_t len;
+    uint32_t count;
+    uint8_t* post;     /* the postings so far */
+    size_t post_len, post_size;
+    long last_file;
+    uint32_t last_pos, last_frame;
+} term_t;
+
+struct __ccindex_writer_struct {
+    char* path;
+    pthread_mutex_t lock;
+
+    /* the files added since the last segment */
+    char** names;
+    int* services;
+    int* rates;        /* num and den for each */
+    long nfiles, files_size;
+
+    /* their terms, found by hashing their words into table */
+    term_t* terms;
+    long nterms, terms_size;
+    uint32_t* table;   /* term index + 1, or 0 */
+    long table_size;
+    char* words;
+    size_t words_len, words_size;
+
+    size_t bytes;      /* of postings so far */
+};
+
+ccindex_writer_t* ccindex_writer_new(const char* path) {
+    ccindex_writer_t* writer = calloc(1, sizeof(ccindex_writer_t));
+
+    if (!writer)
+	return NULL;
+    writer->path = strdup(path);
+    pthread_mutex_init(&writer->lock, NULL);
+    return writer;
+}
+
+/* FNV-1a */
+static uint32_t hash_word(const char* word, int len) {
+    uint32_t h = 2166136261u;
+    int i;
+
+    for (i = 0; i < len; ++i) {
+	h = (h ^ (uint8_t)word[i]) * 16777619u;
+    }
+    return h;
+}
+
+static int grow(void** p, size_t* size, size_t need, size_t each) {
+    size_t n = *size ? *size : 64;
+    void* grown;
+
+    if (need <= *size)
+	return 0;
+    while (n < need)
+	n *= 2;
+    grown = realloc(*p, n * each);
+    if (!grown)
+	return -1;
+    *p = grown;
+    *size = n;
+    return 0;
+}
+
+/* put every term back in a table twice the size */
+static int rehash(ccindex_writer_t* writer) {
+    long size = writer->table_size ? 2 * writer->table_size : 1024;
+    uint32_t* table = calloc(size, sizeof(uint32_t));
+    term_t* t;
+    long i, j;
+
+    if (!table)
+	return -1;
+    for (i = 0; i < writer->nterms; ++i) {
+	t = &writer->terms[i];
+	j = hash_word(writer->words + t->word, t->len) & (size - 1);
+	while (table[j])
+	    j = (j + 1) & (size - 1);
+	table[j] = i + 1;
+    }
+    free(writer->table);
+    writer->table = table;
+    writer->table_size = size;
+    return 0;
+}
+
+/* the term for a word, made if it's new, or NULL if there's no memory */
+static term_t* find_term(ccindex_writer_t* writer, const char* word, int len) {
+    size_t terms_size = writer->terms_size;
+    term_t* t;
+    long j;
+
+    if (2 * (writer->nterms + 1) > writer->table_size && rehash(writer) != 0)
+	return NULL;
+
+    j = hash_word(word, len) & (writer->table_size - 1);
+    while (writer->table[j]) {
+	t = &writer->terms[writer->table[j] - 1];
+	if (t->len == (uint32_t)len && memcmp(writer->words + t->word, word, len) == 0)
+	    return t;
+	j = (j + 1) & (writer->table_size - 1);
+    }
+
+    if (grow((void**)&writer->terms, &terms_size, writer->nterms + 1, sizeof(term_t)) != 0 ||
+	grow((void**)&writer->words, &writer->words_size, writer->words_len + len, 1) != 0)
+	return NULL;
+    writer->terms_size = terms_size;
+
+    t = &writer->terms[writer->nterms];
+    memset(t, 0, sizeof(term_t));
+    t->word = writer->words_len;
+    t->len = len;
+    t->last_file = -1;
+    memcpy(writer->words + writer->words_len, word, len);
+    writer->words_len += len;
+    writer->table[j] = ++writer->nterms;
+    return t;
+}
+
+static uint8_t* put_varint(uint8_t* p, uint32_t v) {
+    while (v >= 0x80) {
+	*p++ = v | 0x80;
+	v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+static int add_posting(term_t* t, long file, uint32_t pos, uint32_t frame) {
+    uint8_t buf[15];
+    uint8_t* p = buf;
+    int32_t d;
+
+    if (file != t->last_file) {
+	p = put_varint(p, file - t->last_file);
+	p = put_varint(p, pos);
+	p = put_varint(p, frame);
+    } else {
+	d = frame - t->last_frame;
+	p = put_varint(p, 0);
+	p = put_varint(p, pos - t->last_pos);
+	p = put_varint(p, ((uint32_t)d << 1) ^ (uint32_t)(d >> 31));
+    }
+    if (grow((void**)&t->post, &t->post_size, t->post_len + (p - buf), 1) != 0)
+	return -1;
+    memcpy(t->post + t->post_len, buf, p - buf);
+    t->post_len += p - buf;
+    t->count++;
+    t->last_file = file;
+    t->last_pos = pos;
+    t->last_frame = frame;
+    return p - buf;
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static void put64(uint8_t* p, uint64_t v) {
+    put32(p, v);
+    put32(p + 4, v >> 32);
+}
+
+#define ALIGN8(n) (((n) + 7) & ~(size_t)7)
+
+/* a term, for sorting by its word */
+typedef struct {
+    const char* word;
+    term_t* term;
+} sort_t;
+
+static int compare_terms(const void* a, const void* b) {
+    const sort_t* x = (const sort_t*)a;
+    const sort_t* y = (const sort_t*)b;
+    uint32_t xlen = x->term->len, ylen = y->term->len;
+    int c = memcmp(x->word, y->word, xlen < ylen ? xlen : ylen);
+
+    return c ? c : (int)xlen - (int)ylen;
+}
+
+static int write_all(int fd, const uint8_t* p, size_t len) {
+    ssize_t n;
+
+    while (len > 0) {
+	n = write(fd, p, len);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n < 0)
+	    return -1;
+	p += n;
+	len -= n;
+    }
+    return 0;
+}
+
+/* forget the files and terms written out */
+static void clear(ccindex_writer_t* writer) {
+    long i;
+
+    for (i = 0; i < writer->nfiles; ++i) {
+	free(writer->names[i]);
+    }
+    for (i = 0; i < writer->nterms; ++i) {
+	free(writer->terms[i].post);
+    }
+    writer->nfiles = 0;
+    writer->nterms = 0;
+    writer->words_len = 0;
+    writer->bytes = 0;
+    if (writer->table)
+	memset(writer->table, 0, writer->table_size * sizeof(uint32_t));
+}
+
+/* append the files added since the last segment as a new one */
+static int write_segment(ccindex_writer_t* writer) {
+    size_t files_off, terms_off, post_off, strings_off, size, names = 0, post = 0, len;
+    sort_t* order;
+    uint8_t* seg;
+    uint8_t* p;
+    term_t* t;
+    long i;
+    int fd, ret = 0, saved;
+
+    if (writer->nfiles == 0)
+	return 0;
+
+    for (i = 0; i < writer->nfiles; ++i) {
+	names += strlen(writer->names[i]) + 1;
+    }
+    for (i = 0; i < writer->nterms; ++i) {
+	post += writer->terms[i].post_len;
+    }
+    files_off = HEADER_SIZE;
+    terms_off = files_off + FILE_SIZE * writer->nfiles;
+    post_off = terms_off + TERM_SIZE * writer->nterms;
+    strings_off = ALIGN8(post_off + post);
+    size = ALIGN8(strings_off + names + writer->words_len);
+
+    order = malloc(writer->nterms * sizeof(sort_t) + 1);
+    seg = calloc(1, size);
+    if (!order || !seg) {
+	free(order);
+	free(seg);
+	errno = ENOMEM;
+	return -1;
+    }
+    for (i = 0; i < writer->nterms; ++i) {
+	order[i].word = writer->words + writer->terms[i].word;
+	order[i].term = &writer->terms[i];
+    }
+    qsort(order, writer->nterms, sizeof(sort_t), compare_terms);
+
+    memcpy(seg, MAGIC, 4);
+    put32(seg + 4, VERSION);
+    put64(seg + 8, size);
+    put32(seg + 16, writer->nfiles);
+    put32(seg + 20, writer->nterms);
+    put64(seg + 24, files_off);
+    put64(seg + 32, terms_off);
+    put64(seg + 40, post_off);
+    put64(seg + 48, strings_off);
+
+    /* the names, then the words, at the start of the strings */
+    len = 0;
+    for (i = 0; i < writer->nfiles; ++i) {
+	p = seg + files_off + FILE_SIZE * i;
+	put32(p, len);
+	put32(p + 4, writer->services[i]);
+	put32(p + 8, writer->rates[2*i]);
+	put32(p + 12, writer->rates[2*i + 1]);
+	strcpy((char*)seg + strings_off + len, writer->names[i]);
+	len += strlen(writer->names[i]) + 1;
+    }
+    memcpy(seg + strings_off + names, writer->words, writer->words_len);
+
+    post = 0;
+    for (i = 0; i < writer->nterms; ++i) {
+	t = order[i].term;
+	p = seg + terms_off + TERM_SIZE * i;
+	put32(p, names + t->word);
+	put32(p + 4, t->len);
+	put64(p + 8, post);
+	put32(p + 16, t->post_len);
+	put32(p + 20, t->count);
+	memcpy(seg + post_off + post, t->post, t->post_len);
+	post += t->post_len;
+    }
+
+    fd = open(writer->path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0 || write_all(fd, seg, size) != 0)
+	ret = -1;
+    saved = errno;
+    if (fd >= 0 && close(fd) != 0)
+	ret = -1;
+    else
+	errno = saved;
+
+    free(order);
+    free(seg);
+    clear(writer);
+    return ret;
+}
+
+/* make room for one more file */
+static int grow_files(ccindex_writer_t* writer) {
+    long size = writer->files_size ? 2 * writer->files_size : 64;
+    char** names;
+    int* services;
+    int* rates;
+
+    if (writer->nfiles < writer->files_size)
+	return 0;
+    names = realloc(writer->names, size * sizeof(char*));
+    if (names)
+	writer->names = names;
+    services = realloc(writer->services, size * sizeof(int));
+    if (services)
+	writer->services = services;
+    rates = realloc(writer->rates, 2 * size * sizeof(int));
+    if (rates)
+	writer->rates = rates;
+    if (!names || !services || !rates)
+	return -1;
+    writer->files_size = size;
+    return 0;
+}
+
+int ccindex_writer_add(ccindex_writer_t* writer, ccindex_doc_t* doc) {
+    const uint8_t* w;
+    uint32_t frame, pos = 0;
+    term_t* t;
+    long file;
+    int n, ret = 0;
+
+    end_caption(doc, doc->ended);
+
+    pthread_mutex_lock(&writer->lock);
+    if (doc->failed || grow_files(writer) != 0) {
+	errno = ENOMEM;
+	ret = -1;
+	goto done;
+    }
+
+    file = writer->nfiles++;
+    writer->names[file] = doc->name;
+    writer->services[file] = doc->service;
+    writer->rates[2*file] = doc->rate_num;
+    writer->rates[2*file + 1] = doc->rate_den;
+    doc->name = NULL;
+
+    for (w = doc->words; w < doc->words + doc->len; w += 5 + w[4]) {
+	memcpy(&frame, w, 4);
+	t = find_term(writer, (const char*)w + 5, w[4]);
+	n = t ? add_posting(t, file, pos++, frame) : -1;
+	if (n < 0) {
+	    errno = ENOMEM;
+	    ret = -1;
+	    break;
+	}
+	writer->bytes += n;
+    }
+
+    if (ret == 0 && writer->bytes >= SEGMENT_BYTES)
+	ret = write_segment(writer);
+done:
+    pthread_mutex_unlock(&writer->lock);
+    ccindex_doc_free(doc);
+    return ret;
+}
+
+int ccindex_writer_close(ccindex_writer_t* writer) {
+    int ret = write_segment(writer);
+    int saved = errno;
+
+    clear(writer);
+    free(writer->names);
+    free(writer->services);
+    free(writer->rates);
+    free(writer->terms);
+    free(writer->table);
+    free(writer->words);
+    free(writer->path);
+    pthread_mutex_destroy(&writer->lock);
+    free(writer);
+    errno = saved;
+    return ret;
+}
+
+/* searching */
+
+typedef struct {
+    const uint8_t* base;
+    uint64_t size;
+    uint32_t nfiles, nterms;
+    const uint8_t *files, *terms, *post, *strings;
+    uint64_t post_size, strings_size;
+    long first_file; /* of the index, for counting */
+} segment_t;
+
+struct __ccindex_struct {
+    uint8_t* map;
+    size_t size;
+    segment_t* segs;
+    int nsegs;
+    long nfiles;
+};
+
+static uint32_t get32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get64(const uint8_t* p) {
+    return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+/* check a segment's header and tables, up to size bytes at p */
+static int read_segment(segment_t* s, const uint8_t* p, uint64_t size) {
+    uint64_t files_off, terms_off, post_off, strings_off;
+    uint32_t i, off;
+    const uint8_t* t;
+
+    if (size < HEADER_SIZE || memcmp(p, MAGIC, 4) != 0 || get32(p + 4) != VERSION)
+	return -1;
+    s->base = p;
+    s->size = get64(p + 8);
+    s->nfiles = get32(p + 16);
+    s->nterms = get32(p + 20);
+    files_off = get64(p + 24);
+    terms_off = get64(p + 32);
+    post_off = get64(p + 40);
+    strings_off = get64(p + 48);
+
+    if (s->size > size || s->size % 8 != 0 ||
+	files_off != HEADER_SIZE || terms_off != files_off + (uint64_t)FILE_SIZE * s->nfiles ||
+	post_off != terms_off + (uint64_t)TERM_SIZE * s->nterms ||
+	strings_off < post_off || strings_off > s->size)
+	return -1;
+    s->files = p + files_off;
+    s->terms = p + terms_off;
+    s->post = p + post_off;
+    s->post_size = strings_off - post_off;
+    s->strings = p + strings_off;
+    s->strings_size = s->size - strings_off;
+
+    /* every name ends inside the strings, and every term is inside them */
+    for (i = 0; i < s->nfiles; ++i) {
+	off = get32(s->files + FILE_SIZE * i);
+	if (off >= s->strings_size || get32(s->files + FILE_SIZE * i + 12) == 0 ||
+	    !memchr(s->strings + off, '\0', s->strings_size - off))
+	    return -1;
+    }
+    for (i = 0; i < s->nterms; ++i) {
+	t = s->terms + TERM_SIZE * i;
+	if ((uint64_t)get32(t) + get32(t + 4) > s->strings_size ||
+	    get64(t + 8) + get32(t + 16) > s->post_size)
+	    return -1;
+    }
+    return 0;
+}
+
+ccindex_t* ccindex_open(const char* path, const char** error) {
+    ccindex_t* index;
+    struct stat st;
+    segment_t* segs;
+    size_t off = 0;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+	*error = strerror(errno);
+	if (fd >= 0)
+	    close(fd);
+	return NULL;
+    }
+
+    index = calloc(1, sizeof(ccindex_t));
+    index->size = st.st_size;
+    if (index->size > 0) {
+	index->map = mmap(NULL, index->size, PROT_READ, MAP_SHARED, fd, 0);
+	if (index->map == MAP_FAILED) {
+	    *error = strerror(errno);
+	    close(fd);
+	    free(index);
+	    return NULL;
+	}
+    }
+    close(fd);
+
+    /* a segment cut short by a crash mid-write ends the index */
+    while (off < index->size) {
+	segs = realloc(index->segs, (index->nsegs + 1) * sizeof(segment_t));
+	if (!segs)
+	    break;
+	index->segs = segs;
+	if (read_segment(&segs[index->nsegs], index->map + off, index->size - off) != 0) {
+	    if (index->nsegs == 0) {
+		*error = "not a caption index";
+		ccindex_close(index);
+		return NULL;
+	    }
+	    break;
+	}
+	segs[index->nsegs].first_file = index->nfiles;
+	index->nfiles += segs[index->nsegs].nfiles;
+	off += segs[index->nsegs++].size;
+    }
+
+    return index;
+}
+
+void ccindex_close(ccindex_t* index) {
+    if (index->map)
+	munmap(index->map, index->size);
+    free(index->segs);
+    free(index);
+}
+
+long ccindex_files(ccindex_t* index) {
+    return index->nfiles;
+}
+
+int ccindex_segments(ccindex_t* index) {
+    return index->nsegs;
+}
+
+/* the term entry for a word in a segment, or NULL */
+static const uint8_t* lookup(const segment_t* s, const char* word, int len) {
+    uint32_t lo = 0, hi = s->nterms, mid, tlen;
+    const uint8_t* t;
+    int c;
+
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	t = s->terms + TERM_SIZE * mid;
+	tlen = get32(t + 4);
+	c = memcmp(s->strings + get32(t), word, tlen < (uint32_t)len ? tlen : (uint32_t)len);
+	if (c == 0)
+	    c = (int)tlen - len;
+	if (c == 0)
+	    return t;
+	if (c < 0)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return NULL;
+}
+
+typedef struct {
+    uint32_t file, pos, frame;
+} posting_t;
+
+static const uint8_t* get_varint(const uint8_t* p, const uint8_t* end, uint32_t* v) {
+    int shift = 0;
+
+    *v = 0;
+    while (p < end && shift < 35) {
+	*v |= (uint32_t)(*p & 0x7F) << shift;
+	if (!(*p++ & 0x80))
+	    return p;
+	shift += 7;
+    }
+    return NULL;
+}
+
+/* the postings of a term entry, or NULL; *count is set to how many */
+static posting_t* postings(const segment_t* s, const uint8_t* t, uint32_t* count) {
+    const uint8_t* p = s->post + get64(t + 8);
+    const uint8_t* end = p + get32(t + 16);
+    uint32_t n = get32(t + 20), i, d, pos, frame, last_pos = 0, last_frame = 0;
+    posting_t* out = malloc((n ? n : 1) * sizeof(posting_t));
+    long file = -1;
+
+    if (!out)
+	return NULL;
+    for (i = 0; i < n; ++i) {
+	p = get_varint(p, end, &d);
+	if (p)
+	    p = get_varint(p, end, &pos);
+	if (p)
+	    p = get_varint(p, end, &frame);
+	if (!p)
+	    break;
+	if (d) {
+	    file += d;
+	    last_pos = pos;
+	    last_frame = frame;
+	} else {
+	    last_pos += pos;
+	    last_frame += (frame >> 1) ^ -(frame & 1);
+	}
+	if (file < 0 || file >= s->nfiles)
+	    break;
+	out[i].file = file;
+	out[i].pos = last_pos;
+	out[i].frame = last_frame;
+    }
+    *count = i;
+    return out;
+}
+
+typedef struct {
+    char words[PHRASE_MAX][CCINDEX_WORD_MAX + 4];
+    int lens[PHRASE_MAX];
+    int n;
+} phrase_t;
+
+static void add_phrase_word(void* data, const char* word, int len) {
+    phrase_t* phrase = (phrase_t*)data;
+
+    if (phrase->n < PHRASE_MAX) {
+	memcpy(phrase->words[phrase->n], word, len);
+	phrase->lens[phrase->n++] = len;
+    }
+}
+
+/* whether a posting comes before file and word number pos */
+static inline int before(const posting_t* p, uint32_t file, uint32_t pos) {
+    return p->file < file || (p->file == file && p->pos < pos);
+}
+
+/* every place in one segment the phrase starts */
+static long find_in(const segment_t* s, const phrase_t* phrase, ccindex_hit_fn fn, void* data) {
+    posting_t* lists[PHRASE_MAX];
+    uint32_t counts[PHRASE_MAX], at[PHRASE_MAX];
+    const uint8_t* t;
+    const uint8_t* f;
+    ccindex_hit_t hit;
+    long hits = 0;
+    uint32_t i;
+    int k, n = 0;
+
+    counts[0] = 0;
+    for (k = 0; k < phrase->n; ++k) {
+	t = lookup(s, phrase->words[k], phrase->lens[k]);
+	if (!t || !(lists[k] = postings(s, t, &counts[k])))
+	    goto done;
+	at[k] = 0;
+	n++;
+    }
+
+    /* walk the first word's places, keeping the others' up with them */
+    for (i = 0; i < counts[0]; ++i) {
+	for (k = 1; k < n; ++k) {
+	    while (at[k] < counts[k] &&
+		   before(&lists[k][at[k]], lists[0][i].file, lists[0][i].pos + k))
+		at[k]++;
+	    if (at[k] == counts[k])
+		goto done;
+	    if (lists[k][at[k]].file != lists[0][i].file ||
+		lists[k][at[k]].pos != lists[0][i].pos + k)
+		break;
+	}
+	if (k < n)
+	    continue;
+
+	f = s->files + FILE_SIZE * lists[0][i].file;
+	hit.name = (const char*)s->strings + get32(f);
+	hit.service = get32(f + 4);
+	hit.frame = lists[0][i].frame;
+	hit.rate_num = get32(f + 8);
+	hit.rate_den = get32(f + 12);
+	fn(data, &hit);
+	hits++;
+    }
+
+done:
+    for (k = 0; k < n; ++k) {
+	free(lists[k]);
+    }
+    return hits;
+}
+
+long ccindex_find(ccindex_t* index, const char* phrase, ccindex_hit_fn fn, void* data) {
+    phrase_t words;
+    long hits = 0;
+    int i;
+
+    words.n = 0;
+    split_words(phrase, add_phrase_word, &words);
+    if (words.n == 0)
+	return -1;
+
+    for (i = 0; i < index->nsegs; ++i) {
+	hits += find_in(&index->segs[i], &words, fn, data);
+    }
+    return hits;
+}
@@ -0,0 +1,91 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __CCINDEX_H
+#define __CCINDEX_H
+
+#include "eia608.h"
+
+/*
+ * A full-text index of what the captions of an archive said, for finding
+ * every place a phrase was said.  words are folded to lower case and
+ * numbered through each file's captions, so a phrase is found across
+ * line breaks and from one caption to the next; each place also has the
+ * frame its caption appeared on.
+ *
+ * the index is one file of segments.  each is written whole and never
+ * changed, so files are added any time by appending another segment, and
+ * the index is read by mapping the whole file in.
+ */
+
+/* words longer than this are cut short */
+#define CCINDEX_WORD_MAX 32
+
+typedef struct __ccindex_doc_struct ccindex_doc_t;
+typedef struct __ccindex_writer_struct ccindex_writer_t;
+typedef struct __ccindex_struct ccindex_t;
+
+/* the words of one service of one file, as it's decoded at num/den frames
+   a second */
+ccindex_doc_t* ccindex_doc_new(const char* name, int service, int num, int den);
+void ccindex_doc_free(ccindex_doc_t* doc);
+
+/* an eia608_event_fn that takes the words of each caption as it goes: a
+   pop-on or paint-on caption when it's erased or replaced, and each new
+   row of roll-up or text as it scrolls.  give it the doc as data. */
+void ccindex_event(void* data, const eia608_event_t* event);
+
+/* add to the index at path, which is made if need be.  files' words are
+   kept in memory and written out as a segment every so often. */
+ccindex_writer_t* ccindex_writer_new(const char* path);
+
+/* add the words of a doc, the caption still on screen included, and free
+   the doc.  can be called from several threads at once.  returns 0, or -1
+   with errno set if a segment couldn't be written. */
+int ccindex_writer_add(ccindex_writer_t* writer, ccindex_doc_t* doc);
+
+/* write out what's left and free the writer.  returns 0, or -1 with errno
+   set if it couldn't be written. */
+int ccindex_writer_close(ccindex_writer_t* writer);
+
+/* map the index at path to search it.  returns NULL, setting *error, if
+   it can't be read. */
+ccindex_t* ccindex_open(const char* path, const char** error);
+void ccindex_close(ccindex_t* index);
+
+/* where a phrase was said */
+typedef struct {
+    const char* name; /* of the file, good until the index is closed */
+    int service;
+    long frame;       /* that the caption appeared on */
+    int rate_num, rate_den;
+} ccindex_hit_t;
+
+typedef void (*ccindex_hit_fn)(void* data, const ccindex_hit_t* hit);
+
+/* call fn for every place the words of phrase were said one after the
+   other, file by file in the order they were added.  returns the number
+   of places, or -1 if the phrase has no words in it. */
+long ccindex_find(ccindex_t* index, const char* phrase, ccindex_hit_fn fn, void* data);
+
+/* how many files and segments are in the index */
+long ccindex_files(ccindex_t* index);
+int ccindex_segments(ccindex_t* index);
+
+#endif /* ndef __CCINDEX_H */
@@ -0,0 +1,171 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "ccscan.h"
+
+/* what goes in place of a missing cc pack: odd parity, and no data */
+static const uint8_t padding[4] = {0x80, 0x80, 0x80, 0x80};
+
+/* chunk c is scanned into slot c % nslots, once the consumer has finished
+   with chunk c - nslots */
+typedef struct {
+    long chunk; /* -1 if free */
+    int ready;
+    uint8_t bytes[CCSCAN_CHUNK * 4];
+} slot_t;
+
+typedef struct {
+    ccscan_extract_fn extract;
+    void* source;
+    long nframes, nchunks;
+
+    pthread_mutex_t lock;
+    pthread_cond_t scanned;  /* a slot has become ready */
+    pthread_cond_t consumed; /* a slot has become free */
+    long next_chunk;         /* the next chunk for a worker to claim */
+    int nslots;
+    slot_t* slots;
+} scan_t;
+
+static long scan_chunk(ccscan_extract_fn extract, void* source, long nframes,
+		       long chunk, uint8_t* bytes) {
+    long first = chunk * CCSCAN_CHUNK;
+    long n = nframes - first;
+    long i;
+
+    if (n > CCSCAN_CHUNK)
+	n = CCSCAN_CHUNK;
+
+    for (i = 0; i < n; ++i) {
+	if (extract(source, first + i, bytes + 4*i) != 0)
+	    memcpy(bytes + 4*i, padding, 4);
+    }
+
+    return n;
+}
+
+static void* worker(void* arg) {
+    scan_t* scan = (scan_t*)arg;
+    slot_t* slot;
+    long chunk;
+
+    pthread_mutex_lock(&scan->lock);
+    while (scan->next_chunk < scan->nchunks) {
+	chunk = scan->next_chunk;
+	slot = &scan->slots[chunk % scan->nslots];
+	if (slot->chunk != -1) {
+	    /* the consumer hasn't caught up yet */
+	    pthread_cond_wait(&scan->consumed, &scan->lock);
+	    continue;
+	}
+	slot->chunk = chunk;
+	slot->ready = 0;
+	scan->next_chunk++;
+	pthread_mutex_unlock(&scan->lock);
+
+	scan_chunk(scan->extract, scan->source, scan->nframes, chunk, slot->bytes);
+
+	pthread_mutex_lock(&scan->lock);
+	slot->ready = 1;
+	pthread_cond_broadcast(&scan->scanned);
+    }
+    pthread_mutex_unlock(&scan->lock);
+
+    return NULL;
+}
+
+int ccscan_run(ccscan_extract_fn extract, void* source, long nframes,
+	       int nthreads, ccscan_sink_fn sink, void* data) {
+    scan_t scan;
+    pthread_t* threads;
+    long chunk, n;
+    int i, started;
+
+    scan.nchunks = (nframes + CCSCAN_CHUNK - 1) / CCSCAN_CHUNK;
+
+    if (nthreads <= 1) {
+	uint8_t bytes[CCSCAN_CHUNK * 4];
+
+	for (chunk = 0; chunk < scan.nchunks; ++chunk) {
+	    n = scan_chunk(extract, source, nframes, chunk, bytes);
+	    sink(data, chunk * CCSCAN_CHUNK, n, bytes);
+	}
+	return 0;
+    }
+
+    scan.extract = extract;
+    scan.source = source;
+    scan.nframes = nframes;
+    scan.next_chunk = 0;
+    scan.nslots = 2 * nthreads;
+    scan.slots = (slot_t*)malloc(scan.nslots * sizeof(slot_t));
+    threads = (pthread_t*)malloc(nthreads * sizeof(pthread_t));
+    if (!scan.slots || !threads) {
+	free(scan.slots);
+	free(threads);
+	return -1;
+    }
+    for (i = 0; i < scan.nslots; ++i) {
+	scan.slots[i].chunk = -1;
+    }
+    pthread_mutex_init(&scan.lock, NULL);
+    pthread_cond_init(&scan.scanned, NULL);
+    pthread_cond_init(&scan.consumed, NULL);
+
+    for (started = 0; started < nthreads; ++started) {
+	if (pthread_create(&threads[started], NULL, worker, &scan) != 0)
+	    break;
+    }
+
+    if (started > 0) {
+	for (chunk = 0; chunk < scan.nchunks; ++chunk) {
+	    slot_t* slot = &scan.slots[chunk % scan.nslots];
+
+	    pthread_mutex_lock(&scan.lock);
+	    while (slot->chunk != chunk || !slot->ready)
+		pthread_cond_wait(&scan.scanned, &scan.lock);
+	    pthread_mutex_unlock(&scan.lock);
+
+	    n = nframes - chunk * CCSCAN_CHUNK;
+	    sink(data, chunk * CCSCAN_CHUNK, n < CCSCAN_CHUNK ? n : CCSCAN_CHUNK,
+		 slot->bytes);
+
+	    pthread_mutex_lock(&scan.lock);
+	    slot->chunk = -1;
+	    pthread_cond_broadcast(&scan.consumed);
+	    pthread_mutex_unlock(&scan.lock);
+	}
+    }
+
+    for (i = 0; i < started; ++i) {
+	pthread_join(threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&scan.consumed);
+    pthread_cond_destroy(&scan.scanned);
+    pthread_mutex_destroy(&scan.lock);
+    free(threads);
+    free(scan.slots);
+
+    return started > 0 ? 0 : -1;
+}
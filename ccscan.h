@@ -0,0 +1,45 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __CCSCAN_H
+#define __CCSCAN_H
+
+#include <inttypes.h>
+
+/* frames are scanned in chunks of this many */
+#define CCSCAN_CHUNK 1024
+
+/* copy the four cc bytes of frame i of source to cc.  returns 0 if the
+   frame has them, -1 if not.  when scanning with more than one thread this
+   is called concurrently for different frames. */
+typedef int (*ccscan_extract_fn)(void* source, long i, uint8_t* cc);
+
+/* receive the cc bytes of n frames starting at frame first, four bytes per
+   frame, with frames that had none filled in with null padding so that
+   they can go straight to eia608_input_batch */
+typedef void (*ccscan_sink_fn)(void* data, long first, long n, const uint8_t* bytes);
+
+/* extract the cc bytes of frames 0 to nframes-1 on nthreads threads and
+   hand them to sink in order, on the calling thread.  at most two chunks
+   per thread are in memory at once.  returns 0, or -1 if the threads
+   couldn't be started. */
+int ccscan_run(ccscan_extract_fn extract, void* source, long nframes,
+	       int nthreads, ccscan_sink_fn sink, void* data);
+
+#endif /* ndef __CCSCAN_H */
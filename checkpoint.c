@@ -0,0 +1,176 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "checkpoint.h"
+
+/* an index file is the magic number, the interval and the number of
+   checkpoints, then each checkpoint's frame and saved state; all numbers
+   are 8 bytes, little-endian */
+static const char magic[8] = "CC608IDX";
+
+struct __checkpoint_struct {
+    long interval;
+    long n, size;
+    long* frames;
+    uint8_t* states; /* EIA608_STATE_SIZE bytes for each of frames[] */
+};
+
+checkpoint_t* checkpoint_new(long interval) {
+    checkpoint_t* index = malloc(sizeof(checkpoint_t));
+
+    if (!index)
+	return NULL;
+    memset(index, 0, sizeof(checkpoint_t));
+    index->interval = interval;
+
+    return index;
+}
+
+void checkpoint_free(checkpoint_t* index) {
+    free(index->frames);
+    free(index->states);
+    free(index);
+}
+
+long checkpoint_interval(checkpoint_t* index) {
+    return index->interval;
+}
+
+static int grow(checkpoint_t* index) {
+    long size = index->size ? 2 * index->size : 64;
+    long* frames;
+    uint8_t* states;
+
+    frames = realloc(index->frames, size * sizeof(long));
+    if (!frames)
+	return -1;
+    index->frames = frames;
+    states = realloc(index->states, size * EIA608_STATE_SIZE);
+    if (!states)
+	return -1;
+    index->states = states;
+    index->size = size;
+
+    return 0;
+}
+
+int checkpoint_add(checkpoint_t* index, eia608_t* decoder) {
+    if (index->n == index->size && grow(index) != 0)
+	return -1;
+
+    index->frames[index->n] = eia608_get_frame(decoder);
+    eia608_save_state(decoder, index->states + index->n * EIA608_STATE_SIZE);
+    index->n++;
+
+    return 0;
+}
+
+long checkpoint_seek(checkpoint_t* index, eia608_t* decoder, long frame) {
+    long lo = 0, hi = index->n, mid;
+
+    /* find the first checkpoint after frame */
+    while (lo < hi) {
+	mid = (lo + hi) / 2;
+	if (index->frames[mid] <= frame)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    if (lo == 0)
+	return -1;
+
+    if (eia608_restore_state(decoder, index->states + (lo - 1) * EIA608_STATE_SIZE) != 0)
+	return -1;
+    return index->frames[lo - 1];
+}
+
+static int put(FILE* f, uint64_t value) {
+    uint8_t bytes[8];
+    int i;
+
+    for (i = 0; i < 8; ++i) {
+	bytes[i] = value >> (8*i);
+    }
+    return fwrite(bytes, 8, 1, f) == 1 ? 0 : -1;
+}
+
+static int get(FILE* f, uint64_t* value) {
+    uint8_t bytes[8];
+    int i;
+
+    if (fread(bytes, 8, 1, f) != 1)
+	return -1;
+    *value = 0;
+    for (i = 0; i < 8; ++i) {
+	*value |= (uint64_t)bytes[i] << (8*i);
+    }
+    return 0;
+}
+
+int checkpoint_write(checkpoint_t* index, FILE* f) {
+    long i;
+
+    if (fwrite(magic, sizeof(magic), 1, f) != 1 ||
+	put(f, index->interval) != 0 || put(f, index->n) != 0)
+	return -1;
+
+    for (i = 0; i < index->n; ++i) {
+	if (put(f, index->frames[i]) != 0 ||
+	    fwrite(index->states + i * EIA608_STATE_SIZE, EIA608_STATE_SIZE, 1, f) != 1)
+	    return -1;
+    }
+
+    return 0;
+}
+
+checkpoint_t* checkpoint_read(FILE* f) {
+    char buf[sizeof(magic)];
+    uint64_t interval, n, frame;
+    checkpoint_t* index;
+
+    if (fread(buf, sizeof(buf), 1, f) != 1 || memcmp(buf, magic, sizeof(magic)) != 0 ||
+	get(f, &interval) != 0 || get(f, &n) != 0)
+	return NULL;
+
+    index = checkpoint_new(interval);
+    if (!index)
+	return NULL;
+
+    while (index->n < (long)n) {
+	if (index->n == index->size && grow(index) != 0)
+	    break;
+	if (get(f, &frame) != 0 ||
+	    fread(index->states + index->n * EIA608_STATE_SIZE, EIA608_STATE_SIZE, 1, f) != 1)
+	    break;
+	/* keep the frames in order, or seeking can't find them */
+	if (index->n > 0 && (long)frame <= index->frames[index->n - 1])
+	    break;
+	index->frames[index->n++] = frame;
+    }
+
+    if (index->n != (long)n) {
+	checkpoint_free(index);
+	return NULL;
+    }
+
+    return index;
+}
@@ -0,0 +1,55 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __CHECKPOINT_H
+#define __CHECKPOINT_H
+
+#include <stdio.h>
+
+#include "eia608.h"
+
+/* saved decoder states every so many frames of a stream, so that the
+   screen at any frame can be had by replaying a few frames instead of the
+   whole stream up to it */
+typedef struct __checkpoint_struct checkpoint_t;
+
+/* make an empty index for checkpoints every interval frames */
+checkpoint_t* checkpoint_new(long interval);
+void checkpoint_free(checkpoint_t* index);
+
+long checkpoint_interval(checkpoint_t* index);
+
+/* save the decoder's state as of its current frame.  checkpoints have to
+   be added in increasing order of frame.  returns 0, or -1 if out of
+   memory. */
+int checkpoint_add(checkpoint_t* index, eia608_t* decoder);
+
+/* restore the decoder to the last checkpoint at or before frame, and
+   return that checkpoint's frame; the frames from there up to frame are
+   left to be input.  returns -1, leaving the decoder alone, if there is no
+   such checkpoint. */
+long checkpoint_seek(checkpoint_t* index, eia608_t* decoder, long frame);
+
+/* write an index to a file, or read one back.  checkpoint_write returns 0,
+   or -1 on a write error; checkpoint_read returns NULL if the file isn't
+   an index. */
+int checkpoint_write(checkpoint_t* index, FILE* f);
+checkpoint_t* checkpoint_read(FILE* f);
+
+#endif /* ndef __CHECKPOINT_H */
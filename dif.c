@@ -0,0 +1,74 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Primary reference:
+ * SMPTE 314M, Data Structure for DV-Based Audio, Data, and Compressed Video
+ */
+
+#include <string.h>
+
+#include "dif.h"
+
+/* section types, from the top three bits of the first ID byte */
+#define SCT_HEADER 0x0
+#define SCT_VAUX   0x2
+
+#define VAUX_PACKS 15  /* 5-byte packs per VAUX block, after the 3-byte ID */
+
+int dif_frame_size(const uint8_t* buf) {
+    /* header block of sequence 0: SCT 0, block number 0 */
+    if ((buf[0] >> 5) != SCT_HEADER || (buf[1] >> 4) != 0 || buf[2] != 0)
+	return 0;
+
+    /* DSF: 0 for 525/60, 1 for 625/50 */
+    return buf[3] & 0x80 ? DIF_PAL_SIZE : DIF_NTSC_SIZE;
+}
+
+int dif_seq_vaux_pack(const uint8_t* vaux, int seq, uint8_t pack, uint8_t* data) {
+    int dbn, i;
+
+    for (dbn = 0; dbn < 3; ++dbn, vaux += DIF_BLOCK_SIZE) {
+	if ((vaux[0] >> 5) != SCT_VAUX || (vaux[1] >> 4) != seq || vaux[2] != dbn)
+	    continue;
+
+	for (i = 0; i < VAUX_PACKS; ++i) {
+	    const uint8_t* p = vaux + 3 + 5*i;
+
+	    if (p[0] == pack) {
+		memcpy(data, p + 1, 4);
+		return 0;
+	    }
+	}
+    }
+
+    return -1;
+}
+
+int dif_get_vaux_pack(const uint8_t* frame, int size, uint8_t pack, uint8_t* data) {
+    int seq;
+
+    for (seq = 0; (seq + 1) * DIF_SEQUENCE_SIZE <= size; ++seq) {
+	if (dif_seq_vaux_pack(frame + seq * DIF_SEQUENCE_SIZE + DIF_VAUX_OFFSET,
+			      seq, pack, data) == 0)
+	    return 0;
+    }
+
+    return -1;
+}
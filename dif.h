@@ -0,0 +1,52 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __DIF_H
+#define __DIF_H
+
+#include <inttypes.h>
+
+/* a DV frame is 10 (525/60) or 12 (625/50) DIF sequences of 150 blocks */
+#define DIF_BLOCK_SIZE    80
+#define DIF_SEQUENCE_SIZE (150 * DIF_BLOCK_SIZE)
+#define DIF_NTSC_SIZE     (10 * DIF_SEQUENCE_SIZE)
+#define DIF_PAL_SIZE      (12 * DIF_SEQUENCE_SIZE)
+
+/* within each sequence, blocks 3-5 are the video auxiliary (VAUX) data */
+#define DIF_VAUX_OFFSET   (3 * DIF_BLOCK_SIZE)
+#define DIF_VAUX_SIZE     (3 * DIF_BLOCK_SIZE)
+
+/* the VAUX pack carrying line-21 closed caption bytes */
+#define DIF_PACK_CC       0x65
+
+/* returns the size of the frame whose header block starts buf, or 0 if
+   buf doesn't start with a DIF header block */
+int dif_frame_size(const uint8_t* buf);
+
+/* find VAUX pack `pack' in the three VAUX blocks of DIF sequence seq,
+   which start at vaux, and copy its four data bytes to data.  blocks
+   whose IDs don't say they are that sequence's VAUX are skipped.
+   returns 0 on success, -1 if the pack isn't there. */
+int dif_seq_vaux_pack(const uint8_t* vaux, int seq, uint8_t pack, uint8_t* data);
+
+/* the same, searching every sequence of a whole frame of size bytes in
+   order, like libdv's dv_get_vaux_pack */
+int dif_get_vaux_pack(const uint8_t* frame, int size, uint8_t pack, uint8_t* data);
+
+#endif /* ndef __DIF_H */
@@ -0,0 +1,129 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Frames are found by their header blocks alone.  a frame is read in as
+ * far as its header says it goes and no further, so a whole frame never
+ * has to be moved about; only after losing track of the frames, when the
+ * stream is searched for the next header block, is anything shuffled
+ * down the buffer.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dif.h"
+#include "dvstream.h"
+
+struct __dvstream_struct {
+    int fd;
+    uint8_t* buf;  /* DIF_PAL_SIZE bytes, the larger of the two frames */
+    int len;       /* bytes in buf */
+    int frame;     /* the size of the frame at the start of buf, if any */
+    int eof;
+    long long skipped;
+};
+
+dvstream_t* dvstream_new(int fd) {
+    dvstream_t* stream = calloc(1, sizeof(dvstream_t));
+
+    stream->fd = fd;
+    stream->buf = malloc(DIF_PAL_SIZE);
+    return stream;
+}
+
+void dvstream_free(dvstream_t* stream) {
+    free(stream->buf);
+    free(stream);
+}
+
+/* read until there are want bytes in the buffer.  returns 0, 1 if the
+   stream ends first, or -1 on an error. */
+static int fill(dvstream_t* stream, int want) {
+    ssize_t n;
+
+    while (stream->len < want) {
+	if (stream->eof)
+	    return 1;
+	n = read(stream->fd, stream->buf + stream->len, want - stream->len);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n < 0)
+	    return -1;
+	if (n == 0)
+	    stream->eof = 1;
+	stream->len += n;
+    }
+    return 0;
+}
+
+/* drop the first n bytes of the buffer */
+static void skip(dvstream_t* stream, int n) {
+    memmove(stream->buf, stream->buf + n, stream->len - n);
+    stream->len -= n;
+    stream->skipped += n;
+}
+
+int dvstream_read(dvstream_t* stream, const uint8_t** frame) {
+    int size, i, ret;
+
+    /* done with the last one */
+    if (stream->frame) {
+	stream->len -= stream->frame;
+	stream->frame = 0;
+    }
+
+    for (;;) {
+	ret = fill(stream, DIF_BLOCK_SIZE);
+	if (ret != 0)
+	    break;
+
+	size = dif_frame_size(stream->buf);
+	if (size == 0) {
+	    /* look for the next thing that might be a header block: an ID
+	       of section type 0, sequence 0, block 0 */
+	    for (i = 1; i + 2 < stream->len; ++i) {
+		if ((stream->buf[i] >> 5) == 0 && (stream->buf[i+1] >> 4) == 0 &&
+		    stream->buf[i+2] == 0)
+		    break;
+	    }
+	    skip(stream, i);
+	    continue;
+	}
+
+	ret = fill(stream, size);
+	if (ret != 0)
+	    break;
+	stream->frame = size;
+	*frame = stream->buf;
+	return size;
+    }
+
+    /* a frame cut short by the end isn't any use */
+    if (ret < 0)
+	return -1;
+    skip(stream, stream->len);
+    return 0;
+}
+
+long long dvstream_skipped(dvstream_t* stream) {
+    return stream->skipped;
+}
@@ -0,0 +1,44 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __DVSTREAM_H
+#define __DVSTREAM_H
+
+#include <inttypes.h>
+
+/* raw DV read as it comes from a pipe, socket or anything else that
+   can't seek or be mapped, one frame at a time.  each frame is sized by
+   its own header, so 525/60 and 625/50 can alternate, and only one frame
+   is ever held in memory. */
+typedef struct __dvstream_struct dvstream_t;
+
+/* read from fd, which is left open when the stream is freed */
+dvstream_t* dvstream_new(int fd);
+void dvstream_free(dvstream_t* stream);
+
+/* read the next frame and point *frame at it; it stays there until the
+   next call.  anything that isn't a DIF frame is skipped.  returns the
+   size of the frame, 0 at the end of the stream, or -1 on a read error
+   (with errno set). */
+int dvstream_read(dvstream_t* stream, const uint8_t** frame);
+
+/* how many bytes have been skipped looking for frames */
+long long dvstream_skipped(dvstream_t* stream);
+
+#endif /* ndef __DVSTREAM_H */
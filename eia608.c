@@ -22,10 +22,19 @@
  * Robson, Gary D., _The Closed Captioning Handbook_. ISBN 0240805615.
  */
 
+#include <stddef.h>
 #include <string.h>
+#include <strings.h>
 #include <wchar.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <pthread.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "eia608.h"
 
@@ -47,17 +56,74 @@
 #define CC_ENM 0x2E /* erase nondisplayed memory */
 #define CC_EOC 0x2F /* end of caption */
 
+/* the caption stream in each field is shared by two CC and two TEXT
+   services; this tracks which one it is currently addressing */
+typedef struct {
+    int active;
+    uint8_t last_b1, last_b2;
+    unsigned long parity_errors, duplicates;
+} channel_t;
+
+/* the displayed rows serialized as UTF-8, for eia608_get_row_utf8 */
+struct utf8_rows {
+    size_t len[EIA608_ROWS];
+    char text[EIA608_ROWS][EIA608_UTF8_ROW_MAX + 1];
+};
+
 struct __eia608_struct {
     int x,y;
     int wanted;
-    int active;
+    channel_t chan;
     int cur_attribute;
     int in_back;
-    wchar_t** display; wchar_t** back_display;
-    int** attributes; int** back_attributes;
+    int front; /* which of memory[] is displayed; the other is the back */
+    eia608_cell_t memory[2][EIA608_ROWS][EIA608_COLUMNS];
+    uint8_t rowmap[2][EIA608_ROWS]; /* where each screen row of each is */
     int changed;
     int rolluplines;
-    uint8_t last_b1, last_b2;
+    /* bit n is set when row n of the displayed memory has changed since
+       eia608_get_changed_rows, the legacy view or the UTF-8 cache last
+       looked at it */
+    unsigned dirty, view_stale, utf8_stale;
+    struct legacy_view* view;
+    long frame; /* index of the frame being decoded */
+    int mode;
+    /* event delivery; pending holds the rows with news for the handler */
+    eia608_event_fn handler;
+    void* handler_data;
+    int cue_open, cue_ended;
+    unsigned pending;
+    eia608_stats_t stats; /* all but the channel's counters */
+    struct utf8_rows utf8;
+};
+
+#define ALL_ROWS ((1u << EIA608_ROWS) - 1)
+#define ROW_BIT(row) (1u << (row))
+
+/* the pointer-per-row wchar_t/int screen that eia608_get_screen and
+   eia608_get_attributes have always returned, built only when asked for */
+struct legacy_view {
+    wchar_t* display[EIA608_ROWS];
+    int* attributes[EIA608_ROWS];
+    wchar_t chars[EIA608_ROWS][EIA608_COLUMNS];
+    int attrs[EIA608_ROWS][EIA608_COLUMNS];
+};
+
+/* the screen rows of a memory are found through its row map, so that
+   scrolling and moving rows about only renumbers them */
+#define ROW(c, m, r) ((c)->memory[m][(c)->rowmap[m][r]])
+#define DISPLAYED(c, r) ROW(c, (c)->front, r)
+#define NONDISPLAYED(c, r) ROW(c, (c)->front ^ 1, r)
+#define WRITING(c, r) ROW(c, (c)->front ^ (c)->in_back, r)
+
+/* services are numbered 0-3 for CC1-CC4 and 4-7 for TEXT1-TEXT4 */
+#define EIA608_SERVICES 8
+#define SERVICE_INDEX(s) ((((s) & 0x10) >> 2) | ((s) & 0x03))
+
+struct __eia608_multi_struct {
+    channel_t chan[2];
+    eia608_t* service[EIA608_SERVICES];
+    eia608_t decoders[EIA608_SERVICES];
 };
 
 /* make sure to compile in UTF-8 mode for these to be interpreted correctly! */
@@ -87,64 +153,277 @@ static const int eight_bit_parity[] = {0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0,
 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1, 0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 
 1, 0, 1, 1, 0};
 
-static inline void** alloc_2d_array(int rows, int columns, size_t size) {
-    void** arr = calloc(rows, sizeof(void*));
-    int i;
+/* every possible byte pair (parity bits and all) is sorted ahead of time
+   into one of these classes, so that decoding a pair takes one lookup */
+#define PAIR_IGNORE   0x00 /* bad parity, padding, or not for the decoder */
+#define PAIR_CHAR     0x01 /* one basic character */
+#define PAIR_CHARS    0x02 /* two basic characters */
+#define PAIR_PAC      0x03 /* preamble address code */
+#define PAIR_EXT1     0x04 /* special character */
+#define PAIR_EXT2     0x05 /* extended character, Spanish/French/misc */
+#define PAIR_EXT3     0x06 /* extended character, Portuguese/German/Danish */
+#define PAIR_ATTR     0x07 /* mid-row attribute */
+#define PAIR_TAB      0x08 /* tab offset */
+#define PAIR_CMD      0x09 /* miscellaneous control code */
+#define PAIR_CONTROL  0x0A /* other control pair; only affects the channel */
+#define PAIR_ACTION   0x0F
+
+#define PAIR_CHAN2    0x10 /* control code for CC2, CC4, TEXT2, TEXT4 */
+#define PAIR_TO_CC    0x20 /* control code switches to CC mode */
+#define PAIR_TO_TEXT  0x40 /* control code switches to TEXT mode */
+#define PAIR_PARITY   0x80 /* ignored because of bad parity */
+
+static uint8_t pair_class[65536];
+static pthread_once_t pair_class_once = PTHREAD_ONCE_INIT;
+
+static uint8_t classify_pair(uint8_t b1, uint8_t b2) {
+    uint8_t cls;
+
+    if (!(eight_bit_parity[b1] && eight_bit_parity[b2]))
+	return PAIR_IGNORE | PAIR_PARITY;
 
-    for (i = 0; i < rows; ++i) {
-	arr[i] = calloc(columns, size);
+    b1 &= 0x7f;
+    b2 &= 0x7f;
+
+    if (b1 >= 0x20)
+	return b2 >= 0x20 ? PAIR_CHARS : PAIR_CHAR;
+    if (b1 < 0x10)
+	return PAIR_IGNORE;
+
+    cls = PAIR_CONTROL;
+    if (b1 & 0x08) {
+	cls |= PAIR_CHAN2;
+	b1 &= ~0x08;
+    }
+
+    if (b1 == 0x14) {
+	switch(b2) {
+	case CC_RCL: /* pop-on */
+	case CC_RU2: /* roll-up */
+	case CC_RU3: /* roll-up */
+	case CC_RU4: /* roll-up */
+	case CC_RDC: /* paint-on */
+	    cls |= PAIR_TO_CC;
+	    break;
+	case CC_TR:
+	case CC_RTD:
+	    cls |= PAIR_TO_TEXT;
+	    break;
+	}
     }
 
-    return arr;
+    if (b1 <= 0x17 && b2 >= 0x40) {
+	cls = (cls & ~PAIR_ACTION) | PAIR_PAC;
+    } else if (b1 == 0x11 && b2 >= 0x30 && b2 <= 0x3F) {
+	cls = (cls & ~PAIR_ACTION) | PAIR_EXT1;
+    } else if (b1 == 0x12 && b2 >= 0x20 && b2 <= 0x3F) {
+	cls = (cls & ~PAIR_ACTION) | PAIR_EXT2;
+    } else if (b1 == 0x13 && b2 >= 0x20 && b2 <= 0x3F) {
+	cls = (cls & ~PAIR_ACTION) | PAIR_EXT3;
+    } else if (b1 == 0x11 && b2 >= 0x20 && b2 <= 0x2F) {
+	cls = (cls & ~PAIR_ACTION) | PAIR_ATTR;
+    } else if (b1 == 0x17 && b2 >= 0x21 && b2 <= 0x23) {
+	cls = (cls & ~PAIR_ACTION) | PAIR_TAB;
+    } else if (b1 == 0x14 && b2 >= 0x20 && b2 <= 0x2F) {
+	cls = (cls & ~PAIR_ACTION) | PAIR_CMD;
+    }
+
+    return cls;
 }
 
-static inline void free_2d_array(void* ptr, int rows) {
+static void build_pair_classes(void) {
     int i;
 
-    for (i = 0; i < rows; ++i) {
-	free(((void**)ptr)[i]);
+    for (i = 0; i < 65536; ++i) {
+	pair_class[i] = classify_pair(i >> 8, i & 0xff);
     }
-    free(ptr);
 }
 
-eia608_t* eia608_new() {
-    eia608_t* eia608 = malloc(sizeof(eia608_t));
-    memset(eia608, 0, sizeof(eia608_t));
+static void reset_rowmaps(eia608_t* eia608) {
+    int i;
+
+    for (i = 0; i < EIA608_ROWS; ++i) {
+	eia608->rowmap[0][i] = eia608->rowmap[1][i] = i;
+    }
+}
+
+size_t eia608_sizeof(void) {
+    return sizeof(eia608_t);
+}
+
+size_t eia608_alignof(void) {
+    return _Alignof(eia608_t);
+}
+
+eia608_t* eia608_init(void* mem) {
+    eia608_t* eia608 = (eia608_t*)mem;
+
+    pthread_once(&pair_class_once, build_pair_classes);
 
+    /* the UTF-8 rows are filled in as they are asked for, so they needn't
+       be cleared; a large part of the decoder is left alone that way */
+    memset(eia608, 0, offsetof(eia608_t, utf8));
+    reset_rowmaps(eia608);
     eia608->wanted = EIA608_CC1;
-    eia608->display = (wchar_t**)alloc_2d_array(EIA608_ROWS, EIA608_COLUMNS, sizeof(wchar_t));
-    eia608->back_display = (wchar_t**)alloc_2d_array(EIA608_ROWS, EIA608_COLUMNS, sizeof(wchar_t));
-    eia608->attributes = (int**)alloc_2d_array(EIA608_ROWS, EIA608_COLUMNS, sizeof(int));
-    eia608->back_attributes = (int**)alloc_2d_array(EIA608_ROWS, EIA608_COLUMNS, sizeof(int));
+    eia608->utf8_stale = ALL_ROWS;
 
     return eia608;
 }
 
+void eia608_reset(eia608_t* eia608) {
+    struct legacy_view* view = eia608->view;
+    eia608_event_fn handler = eia608->handler;
+    void* handler_data = eia608->handler_data;
+    int wanted = eia608->wanted;
+
+    eia608_init(eia608);
+    eia608->view = view;
+    eia608->view_stale = ALL_ROWS;
+    eia608->handler = handler;
+    eia608->handler_data = handler_data;
+    eia608_set_wanted(eia608, wanted);
+}
+
+void eia608_fini(eia608_t* eia608) {
+    free(eia608->view);
+}
+
+eia608_t* eia608_new() {
+    return eia608_init(malloc(sizeof(eia608_t)));
+}
+
 void eia608_free(eia608_t* eia608) {
-    free_2d_array(eia608->display, EIA608_ROWS);
-    free_2d_array(eia608->back_display, EIA608_ROWS);
-    free_2d_array(eia608->attributes, EIA608_ROWS);
-    free_2d_array(eia608->back_attributes, EIA608_ROWS);
+    eia608_fini(eia608);
     free(eia608);
 }
 
 int eia608_set_wanted(eia608_t* eia608, int wanted) {
     if ((wanted & 0xEC) == 0) {
 	eia608->wanted = wanted;
+	/* the field is implied by the service, not signalled in the stream */
+	eia608->chan.active = (eia608->chan.active & ~0x02) | (wanted & 0x02);
 	return eia608->wanted;
     }
-    eia608->active = eia608->wanted & 0x2;
     return -1;
 }
 
+int eia608_get_wanted(eia608_t* eia608) {
+    return eia608->wanted;
+}
+
+static const char* service_names[] = {
+    "cc1", "cc2", "cc3", "cc4", "text1", "text2", "text3", "text4"
+};
+static const int service_codes[] = {
+    EIA608_CC1, EIA608_CC2, EIA608_CC3, EIA608_CC4,
+    EIA608_TEXT1, EIA608_TEXT2, EIA608_TEXT3, EIA608_TEXT4
+};
+
+int eia608_parse_service(const char* name) {
+    int i;
+
+    for (i = 0; i < 8; ++i) {
+	if (strcasecmp(name, service_names[i]) == 0)
+	    return service_codes[i];
+    }
+    return -1;
+}
+
+const char* eia608_service_name(int service) {
+    int i;
+
+    for (i = 0; i < 8; ++i) {
+	if (service_codes[i] == service)
+	    return service_names[i];
+    }
+    return "?";
+}
+
+/* note that some rows of the displayed memory have been written to */
+static inline void rows_changed(eia608_t* context, unsigned rows) {
+    context->changed = 1;
+    context->dirty |= rows;
+    context->view_stale |= rows;
+    context->utf8_stale |= rows;
+    context->pending |= rows;
+}
+
+static inline void emit(eia608_t* context, int type, int row) {
+    eia608_event_t event;
+
+    event.type = type;
+    event.frame = context->frame;
+    event.mode = context->mode;
+    event.row = row;
+    event.cells = row >= 0 ? DISPLAYED(context, row) : NULL;
+    context->handler(context->handler_data, &event);
+}
+
+/* the rows of the displayed memory with anything in them */
+static unsigned content_rows(eia608_t* context) {
+    static const eia608_cell_t blank[EIA608_COLUMNS];
+    unsigned rows = 0;
+    int i;
+
+    for (i = 0; i < EIA608_ROWS; ++i) {
+	if (memcmp(DISPLAYED(context, i), blank, sizeof(blank)))
+	    rows |= ROW_BIT(i);
+    }
+    return rows;
+}
+
+/* call before the displayed caption goes away or is replaced wholesale */
+static void end_cue(eia608_t* context) {
+    if (context->cue_open) {
+	emit(context, EIA608_EVENT_CUE_END, -1);
+	context->cue_open = 0;
+	context->cue_ended = 1;
+    }
+}
+
+/* after a pair has been decoded, tell the handler what is on screen now */
+static void flush_events(eia608_t* context) {
+    unsigned rows = context->pending;
+    int i;
+
+    context->pending = 0;
+    if (!context->cue_open) {
+	if (!rows && !context->cue_ended)
+	    return;
+	context->cue_ended = 0;
+	rows = content_rows(context);
+	if (!rows)
+	    return;
+	emit(context, EIA608_EVENT_CUE_START, -1);
+	context->cue_open = 1;
+    }
+
+    for (i = 0; rows; ++i) {
+	if (rows & ROW_BIT(i)) {
+	    emit(context, EIA608_EVENT_ROW, i);
+	    rows &= ~ROW_BIT(i);
+	}
+    }
+}
+
+static void set_mode(eia608_t* context, int mode) {
+    if (context->mode != mode) {
+	context->mode = mode;
+	if (context->handler)
+	    emit(context, EIA608_EVENT_MODE, -1);
+    }
+}
+
 static void append_char(eia608_t* context, wchar_t ch) {
-    if (context->in_back) {
-	context->back_display[context->x][context->y] = ch;
-	context->back_attributes[context->x][context->y] = context->cur_attribute;
+    eia608_cell_t* cell = &WRITING(context, context->x)[context->y];
+
+    cell->ch = ch;
+    cell->attr = context->cur_attribute;
+    if (!context->in_back) {
+	rows_changed(context, ROW_BIT(context->x));
+	context->stats.chars_front++;
     } else {
-	context->display[context->x][context->y] = ch;
-	context->attributes[context->x][context->y] = context->cur_attribute;
-	context->changed = 1;
+	context->stats.chars_back++;
     }
     if (context->y < (EIA608_COLUMNS-1))
 	context->y++;
@@ -155,9 +434,92 @@ static inline void backspace(eia608_t* context) {
 	context->y--;
 }
 
+/* blank a whole memory; which row is where doesn't matter any more */
+static inline void clear_memory(eia608_t* context, int m) {
+    memset(context->memory[m], 0, sizeof(context->memory[m]));
+}
+
+static inline void clear_row(eia608_cell_t* row) {
+    memset(row, 0, sizeof(eia608_cell_t) * EIA608_COLUMNS);
+}
+
+/* the rows of the roll-up window with its base at row; it can't extend
+   above the top of the screen */
+static inline int rollup_lines(eia608_t* context, int row) {
+    int lines = context->rolluplines;
+
+    if (lines > row + 1)
+	lines = row + 1;
+    if (lines < 1)
+	lines = 1;
+    return lines;
+}
+
+static void carriage_return(eia608_t* context) {
+    uint8_t* map = context->rowmap[context->front];
+    int row = context->x;
+    int top = row - rollup_lines(context, row) + 1;
+    uint8_t gone = map[top];
+    int i;
+
+    end_cue(context);
+
+    /* scroll the rows above the base row up by one, losing the top one,
+       which comes back blank as the base row */
+    for (i = top; i < row; ++i) {
+	map[i] = map[i + 1];
+    }
+    map[row] = gone;
+    clear_row(context->memory[context->front][gone]);
+    context->y = 0;
+    rows_changed(context, (ROW_BIT(row + 1) - 1) & ~(ROW_BIT(top) - 1));
+}
+
+/* move the roll-up window from base row from to base row to, taking the
+   place of whatever was there and leaving blank rows behind */
+static void move_rollup(eia608_t* context, int from, int to) {
+    uint8_t* map = context->rowmap[context->front];
+    uint8_t moving[EIA608_ROWS], freed[EIA608_ROWS];
+    unsigned lost = 0, src = 0, dst = 0;
+    int lines = rollup_lines(context, from);
+    int i, k, nfreed = 0;
+
+    /* a window moved up against the top of the screen loses its top */
+    for (k = to + 1; k < lines; ++k) {
+	clear_row(ROW(context, context->front, from - k));
+	lost |= ROW_BIT(from - k);
+    }
+    if (lines > to + 1)
+	lines = to + 1;
+
+    for (k = 0; k < lines; ++k) {
+	src |= ROW_BIT(from - k);
+	dst |= ROW_BIT(to - k);
+	moving[k] = map[from - k];
+    }
+    /* the rows landed on are blanked and left where the window was */
+    for (k = 0; k < lines; ++k) {
+	if (!(src & ROW_BIT(to - k)))
+	    freed[nfreed++] = map[to - k];
+    }
+    for (k = 0; k < lines; ++k) {
+	map[to - k] = moving[k];
+    }
+    for (i = 0, k = 0; i < EIA608_ROWS; ++i) {
+	if ((src & ~dst) & ROW_BIT(i)) {
+	    map[i] = freed[k++];
+	    clear_row(context->memory[context->front][map[i]]);
+	}
+    }
+
+    rows_changed(context, lost | src | dst);
+}
+
 /* interpret a preamble address code (PAC) */
 /* this give a row to go to, and maybe a color, indent, or underline */
 static void interpret_pac(eia608_t* context, uint8_t b1, uint8_t b2) {
+    int from = context->x;
+
     assert(b1 >= 0x10 && b1 <= 0x17);
     assert(b2 >= 0x40 && b2 <= 0x7f);
 
@@ -167,6 +529,10 @@ static void interpret_pac(eia608_t* context, uint8_t b1, uint8_t b2) {
 	context->x++;
     }
 
+    /* in roll-up mode the window goes wherever the base row does */
+    if (context->mode == EIA608_MODE_ROLLUP && context->x != from)
+	move_rollup(context, from, context->x);
+
     if (b2 & 0x10) { /* codes from 0x50-0x5F and 0x70-0x7F are white indent */
 	context->y = (b2 & 0x0E) << 1;
 	context->cur_attribute = EIA608_WHITE;
@@ -193,55 +559,38 @@ static void interpret_attribute(eia608_t* context, uint8_t attr) {
 }
 
 static void swap_memories(eia608_t* context) {
-    wchar_t **tmp_display;
-    int **tmp_attributes;
-
-    tmp_display = context->display;
-    context->display = context->back_display;
-    context->back_display = tmp_display;
-
-    tmp_attributes = context->attributes;
-    context->attributes = context->back_attributes;
-    context->back_attributes = tmp_attributes;
-
-    context->changed = 1;
-}
-
-static void clear_memories(wchar_t** display, int** attributes) {
+    unsigned rows = 0;
     int i;
 
+    /* only the rows that differ between the two memories change on screen */
     for (i = 0; i < EIA608_ROWS; ++i) {
-	wmemset(display[i], 0, EIA608_COLUMNS);
-	memset(attributes[i], 0, EIA608_COLUMNS * sizeof(int));
+	if (memcmp(DISPLAYED(context, i), NONDISPLAYED(context, i),
+		   sizeof(eia608_cell_t) * EIA608_COLUMNS))
+	    rows |= ROW_BIT(i);
     }
-}
 
-static void carriage_return(eia608_t* context) {
-    int i;
-    int row = context->x;
-
-    for (i = 0; i < (context->rolluplines - 1); ++i) {
-	wmemcpy(context->display[row-1], context->display[row], EIA608_COLUMNS);
-	memcpy(context->attributes[row-1], context->attributes[row], EIA608_COLUMNS*sizeof(int));
-    }
-    memset(context->display[context->x], 0, sizeof(wchar_t)*EIA608_COLUMNS);
-    memset(context->attributes[context->x], 0, sizeof(int)*EIA608_COLUMNS);
-    context->changed = 1;
+    end_cue(context);
+    context->front ^= 1;
+    rows_changed(context, rows);
+    context->stats.swaps++;
 }
 
 static void interpret_command(eia608_t* context, uint8_t command) {
+    context->stats.commands[command & 0x0F]++;
+
     switch(command) {
     case CC_RCL:
 	/* resume caption loading -- enter pop-on mode */
 	context->in_back = 1;
+	set_mode(context, EIA608_MODE_POPON);
 	break;
 
     case CC_BS:
 	/* back space */
 	backspace(context);
-	(context->in_back ? context->back_display : context->display)[context->x][context->y] = 0;
+	WRITING(context, context->x)[context->y].ch = 0;
 	if (!context->in_back)
-	    context->changed = 1;
+	    rows_changed(context, ROW_BIT(context->x));
 	break;
 
     case CC_AOF:
@@ -252,8 +601,10 @@ static void interpret_command(eia608_t* context, uint8_t command) {
 
     case CC_DER:
 	/* delete to end of row */
-	wmemset(context->display[context->x] + context->y, 0,
-		EIA608_COLUMNS - context->y);
+	memset(&WRITING(context, context->x)[context->y], 0,
+	       sizeof(eia608_cell_t) * (EIA608_COLUMNS - context->y));
+	if (!context->in_back)
+	    rows_changed(context, ROW_BIT(context->x));
 	break;
 
     case CC_RU2:
@@ -262,6 +613,7 @@ static void interpret_command(eia608_t* context, uint8_t command) {
 	/* roll-up; 2, 3, or 4 rows */
 	context->rolluplines = command - CC_RU2 + 2;
 	context->in_back = 0;
+	set_mode(context, EIA608_MODE_ROLLUP);
 	if (context->rolluplines > context->x)
 	    context->x = 14;
 	break;
@@ -274,6 +626,7 @@ static void interpret_command(eia608_t* context, uint8_t command) {
     case CC_RDC:
 	/* resume direct captioning -- enter paint-on mode */
 	context->in_back = 0;
+	set_mode(context, EIA608_MODE_PAINTON);
 	break;
 
     case CC_TR:
@@ -281,18 +634,20 @@ static void interpret_command(eia608_t* context, uint8_t command) {
 	/* text mode is more-or-less like roll-up mode with many lines */
 	context->in_back = 0;
 	context->rolluplines = 15;
+	set_mode(context, EIA608_MODE_TEXT);
 	interpret_pac(context, 0x14, 0x60); /* reset cursor */
 	break;
 
     case CC_RTD:
 	/* resume text display */
-	/* nothing to do here */
+	set_mode(context, EIA608_MODE_TEXT);
 	break;
 
     case CC_EDM:
 	/* erase displayed memory */
-	clear_memories(context->display, context->attributes);
-	context->changed = 1;
+	end_cue(context);
+	clear_memory(context, context->front);
+	rows_changed(context, ALL_ROWS);
 	break;
 
     case CC_CR:
@@ -301,7 +656,7 @@ static void interpret_command(eia608_t* context, uint8_t command) {
 
     case CC_ENM:
 	/* erase nondisplayed memory */
-	clear_memories(context->back_display, context->back_attributes);
+	clear_memory(context, context->front ^ 1);
 	break;
 
     case CC_EOC:
@@ -316,79 +671,246 @@ static void interpret_command(eia608_t* context, uint8_t command) {
     }
 }
 
-void eia608_input(eia608_t* context, const uint8_t* bytes) {
+/* look up the class of a byte pair, strip parity from it, and track which
+   service the field's caption stream is addressing.  returns the class, or
+   PAIR_IGNORE if there is nothing for the service now named by
+   chan->active to do. */
+static inline int demux_pair(channel_t* chan, uint8_t* input) {
+    int cls = pair_class[(input[0] << 8) | input[1]];
+
+    if ((cls & PAIR_ACTION) == PAIR_IGNORE) {
+	if (cls & PAIR_PARITY)
+	    chan->parity_errors++;
+	return PAIR_IGNORE;
+    }
+
+    /* the class says parity was ok; that done, proceed to ignore it */
+    input[0] &= 0x7f;
+    input[1] &= 0x7f;
+
+    if ((cls & PAIR_ACTION) <= PAIR_CHARS) {
+	/* basic character(s) belong to whichever service is active */
+	chan->last_b1 = chan->last_b2 = 0;
+	return cls;
+    }
+
+    if (input[0] == chan->last_b1 && input[1] == chan->last_b2) {
+	chan->last_b1 = chan->last_b2 = 0;
+	chan->duplicates++;
+	return PAIR_IGNORE;
+    }
+    chan->last_b1 = input[0];
+    chan->last_b2 = input[1];
+
+    /* first determine if the command should make us switch modes. */
+    if (cls & PAIR_CHAN2) { /* CC2, CC4, TEXT2, TEXT4 */
+	chan->active |= 0x01;
+	input[0] &= ~0x08;
+    } else {
+	chan->active &= ~0x01;
+    }
+
+    if (cls & PAIR_TO_CC)
+	chan->active &= ~0x10;
+    else if (cls & PAIR_TO_TEXT)
+	chan->active |= 0x10;
+
+    return cls;
+}
+
+/* act on a byte pair that demux_pair has handed to this service */
+static inline void decode_pair(eia608_t* context, const uint8_t* input, int cls) {
+    context->stats.pairs++;
+
+    switch (cls & PAIR_ACTION) {
+    case PAIR_CHARS:
+	append_char(context, basictab[input[0] - 0x20]);
+	append_char(context, basictab[input[1] - 0x20]);
+	break;
+    case PAIR_CHAR:
+	append_char(context, basictab[input[0] - 0x20]);
+	break;
+    case PAIR_PAC:
+	context->stats.pacs++;
+	interpret_pac(context, input[0], input[1]);
+	break;
+    case PAIR_EXT1:
+	append_char(context, exttab1[input[1] - 0x30]);
+	break;
+    case PAIR_EXT2:
+	backspace(context);
+	append_char(context, exttab2[input[1] - 0x20]);
+	break;
+    case PAIR_EXT3:
+	backspace(context);
+	append_char(context, exttab3[input[1] - 0x20]);
+	break;
+    case PAIR_ATTR:
+	interpret_attribute(context, input[1]);
+	break;
+    case PAIR_TAB:
+	/* TO1, TO2, TO3: Tab offset, 1-3 columns */
+	context->y += (input[1] & 0x03);
+	if (context->y > EIA608_COLUMNS-1)
+	    context->y = EIA608_COLUMNS-1;
+	break;
+    case PAIR_CMD:
+	interpret_command(context, input[1]);
+	break;
+    }
+
+    if (context->handler)
+	flush_events(context);
+}
+
+static inline void input_frame(eia608_t* context, const uint8_t* bytes) {
     uint8_t input[2];
+    int cls;
 
     /* look in field 1 for CC1, 2; field 2 for CC3,4 */
     memcpy(input, bytes + (context->wanted & 0x02 ? 2 : 0), 2);
 
-    /* require odd parity on each byte */
-    if (!(eight_bit_parity[input[0]] && eight_bit_parity[input[1]]))
-        return;
+    /* ok, now proceed iff the mode is right */
+    cls = demux_pair(&context->chan, input);
+    if (cls != PAIR_IGNORE && context->chan.active == context->wanted)
+	decode_pair(context, input, cls);
+    context->frame++;
+}
 
-    /* ok; that done, proceed to ignore parity */
-    *((uint16_t*)input) &= 0x7f7f;
+void eia608_input(eia608_t* context, const uint8_t* bytes) {
+    input_frame(context, bytes);
+}
 
-    if (input[0] >= 0x20 && (context->wanted == context->active)) {
-	/* basic character(s) */
-	append_char(context, basictab[input[0] - 0x20]);
-	if (input[1] >= 0x20)
-	    append_char(context, basictab[input[1] - 0x20]);
+/* the pairs demux_pair ignores are exactly those with bad parity in
+   either byte, or whose first byte (sans parity) is below 0x10; that is
+   what nearly all of a stream is, starting with the 0x80 0x80 padding.
+   find_live finds the first frame at or after i in which one of the
+   fields in the mask FIELD1|FIELD2 has any other kind of pair, or
+   returns nframes, counting the parity errors it passes over in the
+   channels of the two fields.  the vector versions look at several
+   frames at a time; a live pair is one whose bytes both have the 0x01
+   bit set. */
+#define FIELD1 0x01
+#define FIELD2 0x04
 
-	context->last_b1 = context->last_b2 = 0;
-    } else if (input[0] >= 0x10 && input[0] < 0x20) {
-	if (input[0] == context->last_b1 && input[1] == context->last_b2) {
-	    context->last_b1 = context->last_b2 = 0;
-	    return;
-	}
-	context->last_b1 = input[0];
-	context->last_b2 = input[1];
+static inline int frame_live(const uint8_t* frame, unsigned fields) {
+    return (((fields & FIELD1) && (pair_class[(frame[0] << 8) | frame[1]] & PAIR_ACTION)) ||
+	    ((fields & FIELD2) && (pair_class[(frame[2] << 8) | frame[3]] & PAIR_ACTION)));
+}
 
-	/* first determine if the command should make us switch modes. */
-	if (input[0] & 0x08) { /* CC2, CC4, TEXT2, TEXT4 */
-	    context->active |= 0x01;
-	    input[0] &= ~0x08;
-	} else {
-	    context->active &= ~0x01;
+static inline void count_parity(const uint8_t* frame, unsigned fields,
+				channel_t* chan1, channel_t* chan2) {
+    if ((fields & FIELD1) && (pair_class[(frame[0] << 8) | frame[1]] & PAIR_PARITY))
+	chan1->parity_errors++;
+    if ((fields & FIELD2) && (pair_class[(frame[2] << 8) | frame[3]] & PAIR_PARITY))
+	chan2->parity_errors++;
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#if defined(__AVX2__)
+#define VEC_FRAMES 8
+#define vec_t __m256i
+#define vec_load(p) _mm256_loadu_si256((const __m256i*)(p))
+#define vec_set1(b) _mm256_set1_epi8(b)
+#define vec_set4(a,b,c,d) _mm256_set1_epi32(((d) << 24) | ((c) << 16) | ((b) << 8) | (a))
+#define vec_and _mm256_and_si256
+#define vec_andnot _mm256_andnot_si256
+#define vec_xor _mm256_xor_si256
+#define vec_srl16 _mm256_srli_epi16
+#define vec_cmpeq _mm256_cmpeq_epi8
+#define vec_movemask(v) ((uint32_t)_mm256_movemask_epi8(v))
+#else
+#define VEC_FRAMES 4
+#define vec_t __m128i
+#define vec_load(p) _mm_loadu_si128((const __m128i*)(p))
+#define vec_set1(b) _mm_set1_epi8(b)
+#define vec_set4(a,b,c,d) _mm_set1_epi32(((d) << 24) | ((c) << 16) | ((b) << 8) | (a))
+#define vec_and _mm_and_si128
+#define vec_andnot _mm_andnot_si128
+#define vec_xor _mm_xor_si128
+#define vec_srl16 _mm_srli_epi16
+#define vec_cmpeq _mm_cmpeq_epi8
+#define vec_movemask(v) ((uint32_t)_mm_movemask_epi8(v))
+#endif
+
+/* one bit per byte, set if the byte could be part of a live pair; bit
+   4*j + 2*field of the result is for the first byte of a field's pair
+   in frame j.  *parity gets the same bits for just having odd parity. */
+static inline uint32_t live_bytes(const uint8_t* bytes, uint32_t* parity) {
+    vec_t v = vec_load(bytes);
+    vec_t p;
+
+    /* fold each byte's parity into its low bit; shifting 16-bit lanes
+       only ever pulls in bits above the one that's kept */
+    p = vec_xor(v, vec_srl16(v, 4));
+    p = vec_xor(p, vec_srl16(p, 2));
+    p = vec_xor(p, vec_srl16(p, 1));
+    p = vec_cmpeq(vec_and(p, vec_set1(0x01)), vec_set1(0x01));
+    *parity = vec_movemask(p);
+
+    /* and the first byte of each pair has to be at least 0x10 */
+    p = vec_andnot(vec_and(vec_cmpeq(vec_and(v, vec_set1(0x70)), vec_set1(0)),
+			   vec_set4(0xff, 0, 0xff, 0)),
+		   p);
+
+    return vec_movemask(p);
+}
+
+static size_t find_live(const uint8_t* bytes, size_t i, size_t nframes, unsigned fields,
+			channel_t* chan1, channel_t* chan2) {
+    uint32_t each = 0; /* bit 0 of every frame */
+    uint32_t mask, m, p, bad;
+    int j;
+
+    for (j = 0; j < VEC_FRAMES; ++j) {
+	each |= 1u << 4*j;
+    }
+    mask = each * fields;
+
+    for (; i + VEC_FRAMES <= nframes; i += VEC_FRAMES) {
+	m = live_bytes(bytes + 4*i, &p);
+	m &= (m >> 1) & mask;
+	bad = ~(p & (p >> 1)) & mask;
+	if (m) {
+	    /* the live frame itself goes through demux_pair */
+	    j = __builtin_ctz(m) / 4;
+	    bad &= (1u << 4*j) - 1;
 	}
-	
-	if (input[0] == 0x14) {
-	    switch(input[1]) {
-	    case CC_RCL: /* pop-on */
-	    case CC_RU2: /* roll-up */
-	    case CC_RU3: /* roll-up */
-	    case CC_RU4: /* roll-up */
-	    case CC_RDC: /* paint-on */
-		context->active &= ~0x10; /* CC mode */
-		break;
-	    case CC_TR:
-	    case CC_RTD:
-		context->active |= 0x10; /* TEXT mode */
-		break;
-	    }
+	if (bad) {
+	    chan1->parity_errors += __builtin_popcount(bad & (each * FIELD1));
+	    chan2->parity_errors += __builtin_popcount(bad & (each * FIELD2));
 	}
+	if (m)
+	    return i + j;
+    }
 
-	/* ok, now proceed iff the mode is right */
-	if (context->active == context->wanted) {
-	    if (input[0] >= 0x10 && input[0] <= 0x17 && input[1] >= 0x40) {
-		interpret_pac(context, input[0], input[1]);
-	    } else if (input[0] == 0x11 && input[1] >= 0x30 && input[1] <= 0x3F) {
-		append_char(context, exttab1[input[1] - 0x30]);
-	    } else if (input[0] == 0x12 && input[1] >= 0x20 && input[1] <= 0x3F) {
-		backspace(context);
-		append_char(context, exttab2[input[1] - 0x20]);
-	    } else if (input[0] == 0x13 && input[1] >= 0x20 && input[1] <= 0x3F) {
-		backspace(context);
-		append_char(context, exttab3[input[1] - 0x20]);
-	    } else if (input[0] == 0x11 && input[1] >= 0x20 && input[1] <= 0x2F) {
-		interpret_attribute(context, input[1]);
-	    } else if (input[0] == 0x17 && input[1] >= 0x21 && input[1] <= 0x23) {
-		/* TO1, TO2, TO3: Tab offset, 1-3 columns */
-		context->y += (input[1] & 0x03);
-	    } else if (input[0] == 0x14 && input[1] >= 0x20 && input[1] <= 0x2F) {
-		interpret_command(context, input[1]);
-	    }
-	}
+    for (; i < nframes && !frame_live(bytes + 4*i, fields); ++i) {
+	count_parity(bytes + 4*i, fields, chan1, chan2);
+    }
+    return i;
+}
+#else
+static size_t find_live(const uint8_t* bytes, size_t i, size_t nframes, unsigned fields,
+			channel_t* chan1, channel_t* chan2) {
+    for (; i < nframes && !frame_live(bytes + 4*i, fields); ++i) {
+	count_parity(bytes + 4*i, fields, chan1, chan2);
+    }
+    return i;
+}
+#endif
+
+void eia608_input_batch(eia608_t* context, const uint8_t* bytes, size_t nframes) {
+    unsigned field = context->wanted & 0x02 ? FIELD2 : FIELD1;
+    size_t i = 0, live;
+
+    while (i < nframes) {
+	/* ignored pairs don't touch the decoder; just count their frames */
+	live = find_live(bytes, i, nframes, field, &context->chan, &context->chan);
+	context->frame += live - i;
+	if (live == nframes)
+	    break;
+	input_frame(context, bytes + 4*live);
+	i = live + 1;
     }
 }
 
@@ -398,12 +920,338 @@ int eia608_has_changed(eia608_t* context) {
     return tmp;
 }
 
+const eia608_cell_t* eia608_get_row(eia608_t* context, int row) {
+    return DISPLAYED(context, row);
+}
+
+static struct legacy_view* legacy_view(eia608_t* context) {
+    struct legacy_view* view = context->view;
+    int i, j;
+
+    if (!view) {
+	view = context->view = malloc(sizeof(struct legacy_view));
+	for (i = 0; i < EIA608_ROWS; ++i) {
+	    view->display[i] = view->chars[i];
+	    view->attributes[i] = view->attrs[i];
+	}
+	context->view_stale = ALL_ROWS;
+    }
+
+    for (i = 0; context->view_stale; ++i) {
+	if (!(context->view_stale & ROW_BIT(i)))
+	    continue;
+	for (j = 0; j < EIA608_COLUMNS; ++j) {
+	    view->chars[i][j] = DISPLAYED(context, i)[j].ch;
+	    view->attrs[i][j] = DISPLAYED(context, i)[j].attr;
+	}
+	context->view_stale &= ~ROW_BIT(i);
+    }
+
+    return view;
+}
+
 wchar_t** eia608_get_screen(eia608_t* context) {
-    return context->display;
+    return legacy_view(context)->display;
 }
 
 int** eia608_get_attributes(eia608_t* context) {
-    return context->attributes;
+    return legacy_view(context)->attributes;
+}
+
+unsigned eia608_get_changed_rows(eia608_t* context) {
+    unsigned tmp = context->dirty;
+    context->dirty = 0;
+    return tmp;
+}
+
+size_t eia608_row_to_utf8(const eia608_cell_t* row, char* out) {
+    char* p = out;
+    char* end = out; /* just past the last non-blank character */
+    int j;
+
+    for (j = 0; j < EIA608_COLUMNS; ++j) {
+	uint16_t ch = row[j].ch;
+
+	if (ch == 0 || ch == ' ') {
+	    *p++ = ' ';
+	    continue;
+	}
+	if (ch < 0x80) {
+	    *p++ = ch;
+	} else if (ch < 0x800) {
+	    *p++ = 0xC0 | (ch >> 6);
+	    *p++ = 0x80 | (ch & 0x3F);
+	} else {
+	    *p++ = 0xE0 | (ch >> 12);
+	    *p++ = 0x80 | ((ch >> 6) & 0x3F);
+	    *p++ = 0x80 | (ch & 0x3F);
+	}
+	end = p;
+    }
+
+    *end = '\0';
+    return end - out;
+}
+
+const char* eia608_get_row_utf8(eia608_t* context, int row, size_t* len) {
+    struct utf8_rows* utf8 = &context->utf8;
+
+    if (context->utf8_stale & ROW_BIT(row)) {
+	utf8->len[row] = eia608_row_to_utf8(DISPLAYED(context, row), utf8->text[row]);
+	context->utf8_stale &= ~ROW_BIT(row);
+    }
+
+    if (len)
+	*len = utf8->len[row];
+    return utf8->text[row];
+}
+
+void eia608_set_event_handler(eia608_t* context, eia608_event_fn handler, void* data) {
+    context->handler = handler;
+    context->handler_data = data;
+    context->pending = 0;
+    context->cue_open = 0;
+    /* a caption already on screen is announced after the next pair */
+    context->cue_ended = 1;
+}
+
+long eia608_get_frame(eia608_t* context) {
+    return context->frame;
+}
+
+void eia608_set_frame(eia608_t* context, long frame) {
+    context->frame = frame;
+}
+
+void eia608_get_stats(eia608_t* context, eia608_stats_t* stats) {
+    *stats = context->stats;
+    stats->parity_errors = context->chan.parity_errors;
+    stats->duplicates = context->chan.duplicates;
+}
+
+/* a saved state is a version byte, then little-endian fields in the order
+   below, then the cells of both memories */
+#define STATE_VERSION 1
+
+static uint8_t* put(uint8_t* p, uint64_t value, int bytes) {
+    int i;
+
+    for (i = 0; i < bytes; ++i) {
+	*p++ = value >> (8*i);
+    }
+    return p;
+}
+
+static const uint8_t* get(const uint8_t* p, uint64_t* value, int bytes) {
+    int i;
+
+    *value = 0;
+    for (i = 0; i < bytes; ++i) {
+	*value |= (uint64_t)*p++ << (8*i);
+    }
+    return p;
+}
+
+void eia608_save_state(eia608_t* context, uint8_t* state) {
+    uint8_t* p = state;
+    int m, i, j;
+
+    memset(state, 0, EIA608_STATE_SIZE);
+    p = put(p, STATE_VERSION, 1);
+    p = put(p, context->x, 1);
+    p = put(p, context->y, 1);
+    p = put(p, context->wanted, 1);
+    p = put(p, context->chan.active, 1);
+    p = put(p, context->chan.last_b1, 1);
+    p = put(p, context->chan.last_b2, 1);
+    p = put(p, context->cur_attribute, 1);
+    p = put(p, context->in_back, 1);
+    p = put(p, context->front, 1);
+    p = put(p, context->rolluplines, 1);
+    p = put(p, context->mode, 1);
+    p = put(p, context->cue_open, 1);
+    p = put(p, context->cue_ended, 1);
+    p = put(p, (uint64_t)context->frame, 8);
+
+    p = state + 32;
+    for (m = 0; m < 2; ++m) {
+	for (i = 0; i < EIA608_ROWS; ++i) {
+	    for (j = 0; j < EIA608_COLUMNS; ++j) {
+		p = put(p, ROW(context, m, i)[j].ch, 2);
+		p = put(p, ROW(context, m, i)[j].attr, 2);
+	    }
+	}
+    }
+}
+
+int eia608_restore_state(eia608_t* context, const uint8_t* state) {
+    const uint8_t* p = state;
+    uint64_t v[15];
+    int m, i, j;
+
+    for (i = 0; i < 14; ++i) {
+	p = get(p, &v[i], 1);
+    }
+    p = get(p, &v[14], 8);
+
+    /* refuse anything that would put the cursor off the screen */
+    if (v[0] != STATE_VERSION || v[1] >= EIA608_ROWS || v[2] >= EIA608_COLUMNS ||
+	(v[3] & 0xEC) != 0 || v[9] > 1 || v[10] > EIA608_ROWS)
+	return -1;
+
+    /* the handler only learns about the restored screen from here on, so
+       close any cue it was told about and announce the caption afresh
+       after the next pair.  v[12] and v[13] are ignored. */
+    end_cue(context);
+    context->cue_ended = 1;
+
+    context->x = v[1];
+    context->y = v[2];
+    context->wanted = v[3];
+    context->chan.active = v[4];
+    context->chan.last_b1 = v[5];
+    context->chan.last_b2 = v[6];
+    context->cur_attribute = v[7];
+    context->in_back = v[8] != 0;
+    context->front = v[9];
+    context->rolluplines = v[10];
+    context->mode = v[11];
+    context->frame = (long)v[14];
+
+    /* the rows are saved in screen order */
+    reset_rowmaps(context);
+    p = state + 32;
+    for (m = 0; m < 2; ++m) {
+	for (i = 0; i < EIA608_ROWS; ++i) {
+	    for (j = 0; j < EIA608_COLUMNS; ++j) {
+		p = get(p, &v[0], 2);
+		context->memory[m][i][j].ch = v[0];
+		p = get(p, &v[0], 2);
+		context->memory[m][i][j].attr = v[0];
+	    }
+	}
+    }
+
+    /* the screen has to be drawn afresh, but there's no news for the
+       handler: it heard about all this the first time round */
+    context->changed = 1;
+    context->dirty = context->view_stale = context->utf8_stale = ALL_ROWS;
+    context->pending = 0;
+
+    return 0;
+}
+
+size_t eia608_multi_sizeof(void) {
+    return sizeof(eia608_multi_t);
+}
+
+size_t eia608_multi_alignof(void) {
+    return _Alignof(eia608_multi_t);
+}
+
+eia608_multi_t* eia608_multi_init(void* mem) {
+    eia608_multi_t* multi = (eia608_multi_t*)mem;
+    int i;
+
+    memset(multi->chan, 0, sizeof(multi->chan));
+    multi->chan[1].active = 0x02; /* field 2 carries CC3, CC4, TEXT3, TEXT4 */
+    for (i = 0; i < EIA608_SERVICES; ++i) {
+	multi->service[i] = eia608_init(&multi->decoders[i]);
+	/* the inverse of SERVICE_INDEX */
+	eia608_set_wanted(multi->service[i], ((i & 0x04) << 2) | (i & 0x03));
+    }
+
+    return multi;
+}
+
+void eia608_multi_reset(eia608_multi_t* multi) {
+    int i;
+
+    memset(multi->chan, 0, sizeof(multi->chan));
+    multi->chan[1].active = 0x02;
+    for (i = 0; i < EIA608_SERVICES; ++i) {
+	eia608_reset(multi->service[i]);
+    }
+}
+
+void eia608_multi_fini(eia608_multi_t* multi) {
+    int i;
+
+    for (i = 0; i < EIA608_SERVICES; ++i) {
+	eia608_fini(multi->service[i]);
+    }
+}
+
+eia608_multi_t* eia608_multi_new() {
+    return eia608_multi_init(malloc(sizeof(eia608_multi_t)));
+}
+
+void eia608_multi_free(eia608_multi_t* multi) {
+    eia608_multi_fini(multi);
+    free(multi);
+}
+
+static inline void multi_input_frame(eia608_multi_t* multi, const uint8_t* bytes) {
+    uint8_t input[2];
+    int field, cls;
+
+    for (field = 0; field < 2; ++field) {
+	memcpy(input, bytes + 2*field, 2);
+	cls = demux_pair(&multi->chan[field], input);
+	if (cls != PAIR_IGNORE)
+	    decode_pair(multi->service[SERVICE_INDEX(multi->chan[field].active)], input, cls);
+    }
+    for (field = 0; field < EIA608_SERVICES; ++field) {
+	multi->service[field]->frame++;
+    }
+}
+
+void eia608_multi_input(eia608_multi_t* multi, const uint8_t* bytes) {
+    multi_input_frame(multi, bytes);
+}
+
+void eia608_multi_input_batch(eia608_multi_t* multi, const uint8_t* bytes, size_t nframes) {
+    size_t i = 0, live;
+    int j;
+
+    while (i < nframes) {
+	live = find_live(bytes, i, nframes, FIELD1 | FIELD2, &multi->chan[0], &multi->chan[1]);
+	for (j = 0; j < EIA608_SERVICES; ++j) {
+	    multi->service[j]->frame += live - i;
+	}
+	if (live == nframes)
+	    break;
+	multi_input_frame(multi, bytes + 4*live);
+	i = live + 1;
+    }
+}
+
+void eia608_multi_get_stats(eia608_multi_t* multi, eia608_stats_t* stats) {
+    eia608_stats_t* s;
+    int i, j;
+
+    memset(stats, 0, sizeof(eia608_stats_t));
+    for (i = 0; i < EIA608_SERVICES; ++i) {
+	s = &multi->service[i]->stats;
+	stats->pairs += s->pairs;
+	for (j = 0; j < 16; ++j) {
+	    stats->commands[j] += s->commands[j];
+	}
+	stats->pacs += s->pacs;
+	stats->chars_front += s->chars_front;
+	stats->chars_back += s->chars_back;
+	stats->swaps += s->swaps;
+    }
+    for (i = 0; i < 2; ++i) {
+	stats->parity_errors += multi->chan[i].parity_errors;
+	stats->duplicates += multi->chan[i].duplicates;
+    }
+}
+
+eia608_t* eia608_multi_get(eia608_multi_t* multi, int service) {
+    if ((service & 0xEC) != 0)
+	return NULL;
+    return multi->service[SERVICE_INDEX(service)];
 }
 
 /*
@@ -24,6 +24,7 @@
 #include <wchar.h>
 
 typedef struct __eia608_struct eia608_t;
+typedef struct __eia608_multi_struct eia608_multi_t;
 
 /* constants to control which stream you are interested in decoding */
 #define EIA608_CC1   0x00 /* default */
@@ -51,6 +52,40 @@ typedef struct __eia608_struct eia608_t;
 #define EIA608_ROWS      15
 #define EIA608_COLUMNS   32
 
+/* one character position on the screen.  every character EIA-608 can
+   show is in the Basic Multilingual Plane, so 16 bits are enough. */
+typedef struct {
+    uint16_t ch;   /* 0 if there's nothing there */
+    uint16_t attr;
+} eia608_cell_t;
+
+/* each glyph takes at most three bytes of UTF-8 */
+#define EIA608_UTF8_ROW_MAX (EIA608_COLUMNS * 3)
+
+/* caption modes */
+#define EIA608_MODE_POPON   0 /* default */
+#define EIA608_MODE_ROLLUP  1
+#define EIA608_MODE_PAINTON 2
+#define EIA608_MODE_TEXT    3
+
+/* kinds of event a decoder reports to its event handler */
+#define EIA608_EVENT_CUE_START 0 /* a caption has appeared on screen */
+#define EIA608_EVENT_CUE_END   1 /* it has been erased, replaced or scrolled */
+#define EIA608_EVENT_ROW       2 /* a row of the caption has new contents */
+#define EIA608_EVENT_MODE      3 /* the service has changed caption mode */
+
+typedef struct {
+    int type;
+    long frame; /* the frame whose input caused the event */
+    int mode;   /* the caption mode, new in the case of EIA608_EVENT_MODE */
+    int row;    /* for EIA608_EVENT_ROW, the row; -1 otherwise */
+    /* for EIA608_EVENT_ROW, the EIA608_COLUMNS cells of the row; these are
+       only good until the handler returns */
+    const eia608_cell_t* cells;
+} eia608_event_t;
+
+typedef void (*eia608_event_fn)(void* data, const eia608_event_t* event);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -61,20 +96,139 @@ eia608_t* eia608_new();
 /* free memory used by a previously created decoder */
 void eia608_free(eia608_t* eia608);
 
+/* to keep decoders in memory of your own -- an arena, a pool, an array --
+   get eia608_sizeof() bytes aligned to eia608_alignof(), and turn them
+   into a new decoder with eia608_init.  nothing is allocated unless
+   eia608_get_screen or eia608_get_attributes is called, so call
+   eia608_fini before the memory is reused or let go of; it doesn't free
+   the memory itself. */
+size_t eia608_sizeof(void);
+size_t eia608_alignof(void);
+eia608_t* eia608_init(void* mem);
+void eia608_fini(eia608_t* eia608);
+
+/* make a decoder as good as new without reallocating it, keeping only
+   the service it decodes and its event handler */
+void eia608_reset(eia608_t* eia608);
+
 /* choose the CC/TEXT stream in which we are interested */
 int eia608_set_wanted(eia608_t* eia608, int wanted);
+int eia608_get_wanted(eia608_t* eia608);
+
+/* the service called name (cc1-cc4 or text1-text4, in any case), or -1;
+   and the name of a service, or "?" */
+int eia608_parse_service(const char* name);
+const char* eia608_service_name(int service);
 
 /* input four bytes (two for each field) of data */
 void eia608_input(eia608_t* eia608, const uint8_t* bytes);
 
+/* input nframes consecutive four-byte frames, as if by calling
+   eia608_input on each in turn */
+void eia608_input_batch(eia608_t* eia608, const uint8_t* bytes, size_t nframes);
+
 /* returns non-zero iff the screen is different since the last time
    this function was called */
 int eia608_has_changed(eia608_t* eia608);
 
-/* return the current screen and attributes */
+/* returns a bitmask of the rows of the screen that are different since
+   the last time this function was called; bit n is set for row n */
+unsigned eia608_get_changed_rows(eia608_t* eia608);
+
+/* return one row of the current screen as NUL-terminated UTF-8, with
+   empty cells as spaces and trailing blanks removed, and store its length
+   in *len unless len is NULL.  the text is kept until the row changes, so
+   asking again for an unchanged row costs nothing. */
+const char* eia608_get_row_utf8(eia608_t* eia608, int row, size_t* len);
+
+/* have handler called with data as each event happens, or stop if handler
+   is NULL.  every cue start is followed by a row event for each row with
+   something in it, and later by a cue end; in between, a row event is sent
+   whenever characters are written straight to the screen. */
+void eia608_set_event_handler(eia608_t* eia608, eia608_event_fn handler, void* data);
+
+/* the index of the next frame to be input; events carry the index of the
+   frame being decoded.  it starts at zero and can be set, e.g. when the
+   input doesn't start at the beginning of a file. */
+long eia608_get_frame(eia608_t* eia608);
+void eia608_set_frame(eia608_t* eia608, long frame);
+
+/* what a decoder has been up to since it was created */
+typedef struct {
+    unsigned long pairs;         /* byte pairs handed to the service */
+    unsigned long parity_errors; /* pairs dropped for bad parity */
+    unsigned long duplicates;    /* repeated control codes dropped */
+    unsigned long commands[16];  /* by command, RCL (0x20) to EOC (0x2F) */
+    unsigned long pacs;          /* preamble address codes */
+    unsigned long chars_front;   /* characters written to the screen... */
+    unsigned long chars_back;    /* ...and to the nondisplayed memory */
+    unsigned long swaps;         /* times the memories changed places */
+} eia608_stats_t;
+
+/* copy the decoder's counters to stats.  parity errors and duplicates
+   are counted as the field is demultiplexed, so for the services of a
+   multi-service decoder they are only in eia608_multi_get_stats. */
+void eia608_get_stats(eia608_t* eia608, eia608_stats_t* stats);
+
+/* the size of a saved decoder state */
+#define EIA608_STATE_SIZE (32 + 2 * EIA608_ROWS * EIA608_COLUMNS * 4)
+
+/* save everything the decoder will need to carry on from the current
+   frame -- both memories, the cursor, the mode and the channel it is
+   tracking -- into EIA608_STATE_SIZE bytes at state.  the bytes are the
+   same on any machine, so they can be written to a file. */
+void eia608_save_state(eia608_t* eia608, uint8_t* state);
+
+/* put the decoder back the way it was when state was saved, with every
+   row marked as changed; its event handler is left alone.  a cue the
+   handler had open is ended, and whatever is on screen starts a new cue
+   after the next pair.  returns 0, or -1 if state isn't a saved state,
+   leaving the decoder untouched. */
+int eia608_restore_state(eia608_t* eia608, const uint8_t* state);
+
+/* write the EIA608_COLUMNS cells of a row to out as NUL-terminated
+   UTF-8, with empty cells as spaces and trailing blanks removed.  out must
+   have room for EIA608_UTF8_ROW_MAX + 1 bytes.  returns the length. */
+size_t eia608_row_to_utf8(const eia608_cell_t* row, char* out);
+
+/* return the EIA608_COLUMNS cells of one row of the current screen.
+   the pointer is good until the next input. */
+const eia608_cell_t* eia608_get_row(eia608_t* eia608, int row);
+
+/* return the current screen and attributes, as arrays of EIA608_ROWS
+   pointers to rows.  these are copies made on demand; eia608_get_row is
+   cheaper. */
 wchar_t** eia608_get_screen(eia608_t* eia608);
 int** eia608_get_attributes(eia608_t* eia608);
 
+/* create a decoder for all eight CC/TEXT streams at once; each frame is
+   demultiplexed a single time and handed to the right service */
+eia608_multi_t* eia608_multi_new();
+
+/* free a multi-service decoder and all of its per-service decoders */
+void eia608_multi_free(eia608_multi_t* multi);
+
+/* the same as for a single decoder, for a multi-service decoder; its
+   per-service decoders are inside it */
+size_t eia608_multi_sizeof(void);
+size_t eia608_multi_alignof(void);
+eia608_multi_t* eia608_multi_init(void* mem);
+void eia608_multi_fini(eia608_multi_t* multi);
+void eia608_multi_reset(eia608_multi_t* multi);
+
+/* input four bytes (two for each field) of data */
+void eia608_multi_input(eia608_multi_t* multi, const uint8_t* bytes);
+void eia608_multi_input_batch(eia608_multi_t* multi, const uint8_t* bytes, size_t nframes);
+
+/* the sum of the counters of all eight services and both fields */
+void eia608_multi_get_stats(eia608_multi_t* multi, eia608_stats_t* stats);
+
+/* return the decoder holding the screen for one of the EIA608_CC* or
+   EIA608_TEXT* services, or NULL for an unknown service.  it is owned by
+   the multi-service decoder; use it for eia608_has_changed and friends,
+   but never feed it input directly. */
+eia608_t* eia608_multi_get(eia608_multi_t* multi, int service);
+
 #ifdef __cplusplus
 }
 #endif
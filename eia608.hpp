@@ -0,0 +1,663 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __EIA608_HPP
+#define __EIA608_HPP
+
+/*
+ * The decoder of eia608.c as a C++17 template, for a program that knows
+ * at compile time which service it wants.  the service, the type of a
+ * screen cell and where events go are template parameters, so the field
+ * and channel tests are against constants, the character tables and the
+ * class of every byte pair are built by the compiler, and events are
+ * inlined calls instead of calls through eia608_event_fn.
+ *
+ * it decodes exactly as eia608.c does and sends the same events; it has
+ * no multi-service decoder, saved states or legacy screen, for which
+ * there is the C API.  make sure to compile in UTF-8 mode for the tables
+ * to be read correctly!
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "eia608.h"
+
+namespace eia608 {
+
+/* the decoder's own constants; see eia608.c */
+namespace detail {
+
+enum : uint8_t {
+    CC_RCL = 0x20, CC_BS = 0x21, CC_AOF = 0x22, CC_AON = 0x23,
+    CC_DER = 0x24, CC_RU2 = 0x25, CC_RU3 = 0x26, CC_RU4 = 0x27,
+    CC_FON = 0x28, CC_RDC = 0x29, CC_TR = 0x2A, CC_RTD = 0x2B,
+    CC_EDM = 0x2C, CC_CR = 0x2D, CC_ENM = 0x2E, CC_EOC = 0x2F
+};
+
+enum : uint8_t {
+    PAIR_IGNORE = 0x00, PAIR_CHAR = 0x01, PAIR_CHARS = 0x02, PAIR_PAC = 0x03,
+    PAIR_EXT1 = 0x04, PAIR_EXT2 = 0x05, PAIR_EXT3 = 0x06, PAIR_ATTR = 0x07,
+    PAIR_TAB = 0x08, PAIR_CMD = 0x09, PAIR_CONTROL = 0x0A, PAIR_ACTION = 0x0F,
+    PAIR_CHAN2 = 0x10, PAIR_TO_CC = 0x20, PAIR_TO_TEXT = 0x40, PAIR_PARITY = 0x80
+};
+
+constexpr unsigned ALL_ROWS = (1u << EIA608_ROWS) - 1;
+
+constexpr unsigned row_bit(int row) {
+    return 1u << row;
+}
+
+constexpr char16_t basictab[] = u" !\"#$%&'()á+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[é]íóúabcdefghijklmnopqrstuvwxyzç÷Ññ█";
+constexpr char16_t exttab1[] = u"®°½¿™¢£♪à\0èâêîôû";
+constexpr char16_t exttab2[] = u"ÁÉÓÚÜü`¡*'–©℠•“”ÀÂÇÈÊËëÎÏïÔÙùÛ«»";
+constexpr char16_t exttab3[] = u"ÃãÍÌìÒòÕõ{}\\^_|~ÄäÖöß¥¤│ÅåØø┌┐└┘";
+
+static_assert(sizeof(basictab) / sizeof(char16_t) == 96 + 1, "basictab isn't 96 characters");
+static_assert(sizeof(exttab1) / sizeof(char16_t) == 16 + 1, "exttab1 isn't 16 characters");
+static_assert(sizeof(exttab2) / sizeof(char16_t) == 32 + 1, "exttab2 isn't 32 characters");
+static_assert(sizeof(exttab3) / sizeof(char16_t) == 32 + 1, "exttab3 isn't 32 characters");
+
+constexpr int pac_lines[] = {10, 0, 2, 11, 13, 4, 6, 8};
+
+constexpr bool odd_parity(unsigned b) {
+    b ^= b >> 4;
+    b ^= b >> 2;
+    b ^= b >> 1;
+    return b & 1;
+}
+
+/* classify_pair of eia608.c */
+constexpr uint8_t classify_pair(uint8_t b1, uint8_t b2) {
+    uint8_t cls = PAIR_CONTROL;
+
+    if (!(odd_parity(b1) && odd_parity(b2)))
+	return PAIR_IGNORE | PAIR_PARITY;
+
+    b1 &= 0x7f;
+    b2 &= 0x7f;
+
+    if (b1 >= 0x20)
+	return b2 >= 0x20 ? PAIR_CHARS : PAIR_CHAR;
+    if (b1 < 0x10)
+	return PAIR_IGNORE;
+
+    if (b1 & 0x08) {
+	cls |= PAIR_CHAN2;
+	b1 &= ~0x08;
+    }
+
+    if (b1 == 0x14) {
+	if (b2 == CC_RCL || b2 == CC_RU2 || b2 == CC_RU3 || b2 == CC_RU4 || b2 == CC_RDC)
+	    cls |= PAIR_TO_CC;
+	else if (b2 == CC_TR || b2 == CC_RTD)
+	    cls |= PAIR_TO_TEXT;
+    }
+
+    if (b1 <= 0x17 && b2 >= 0x40)
+	return (cls & ~PAIR_ACTION) | PAIR_PAC;
+    if (b1 == 0x11 && b2 >= 0x30 && b2 <= 0x3F)
+	return (cls & ~PAIR_ACTION) | PAIR_EXT1;
+    if (b1 == 0x12 && b2 >= 0x20 && b2 <= 0x3F)
+	return (cls & ~PAIR_ACTION) | PAIR_EXT2;
+    if (b1 == 0x13 && b2 >= 0x20 && b2 <= 0x3F)
+	return (cls & ~PAIR_ACTION) | PAIR_EXT3;
+    if (b1 == 0x11 && b2 >= 0x20 && b2 <= 0x2F)
+	return (cls & ~PAIR_ACTION) | PAIR_ATTR;
+    if (b1 == 0x17 && b2 >= 0x21 && b2 <= 0x23)
+	return (cls & ~PAIR_ACTION) | PAIR_TAB;
+    if (b1 == 0x14 && b2 >= 0x20 && b2 <= 0x2F)
+	return (cls & ~PAIR_ACTION) | PAIR_CMD;
+    return cls;
+}
+
+/* the class of every possible byte pair, parity bits and all, made by
+   the compiler rather than on first use */
+struct pair_classes {
+    uint8_t cls[65536];
+
+    constexpr pair_classes() : cls() {
+	for (int i = 0; i < 65536; ++i) {
+	    cls[i] = classify_pair(i >> 8, i & 0xff);
+	}
+    }
+};
+
+inline constexpr pair_classes pair_class{};
+
+} /* namespace detail */
+
+/* an event as eia608_event_t has it, but with the decoder's own cells */
+template <typename Cell>
+struct event {
+    int type;
+    long frame;
+    int mode;
+    int row;
+    const Cell* cells;
+};
+
+/* the event sink of a decoder that nobody listens to.  with it, nothing
+   is done about events at all. */
+struct null_sink {
+    template <typename Cell>
+    void operator()(const event<Cell>&) {}
+};
+
+/* an event sink that hands events on to an eia608_event_fn, as the C
+   decoder would */
+struct c_sink {
+    eia608_event_fn handler;
+    void* data;
+
+    void operator()(const event<eia608_cell_t>& e) {
+	eia608_event_t out = {e.type, e.frame, e.mode, e.row, e.cells};
+
+	handler(data, &out);
+    }
+};
+
+/*
+ * decodes one of the EIA608_CC* or EIA608_TEXT* services.  Cell is
+ * anything with ch and attr members that value-initializes to an empty
+ * cell, eia608_cell_t by default.  Sink is called with an event<Cell> as
+ * each event happens; it is kept by value in the decoder.
+ */
+template <int Service, typename Cell = eia608_cell_t, typename Sink = null_sink>
+class decoder {
+    static_assert((Service & 0xEC) == 0, "not an EIA608_CC* or EIA608_TEXT* service");
+
+public:
+    static constexpr int service = Service;
+    /* the offset of the service's field in each frame's four bytes */
+    static constexpr int field_offset = Service & 0x02 ? 2 : 0;
+    static constexpr bool has_events = !std::is_same<Sink, null_sink>::value;
+
+    explicit decoder(const Sink& sink = Sink()) : decoder(sink, 0) {}
+
+    /* make the decoder as good as new, keeping its sink */
+    void reset() {
+	Sink sink = sink_;
+
+	*this = decoder(sink, 0);
+    }
+
+    /* input four bytes (two for each field) of data */
+    void input(const uint8_t* bytes) {
+	input_pair(bytes[field_offset], bytes[field_offset + 1]);
+    }
+
+    /* input the pair of the service's field from one frame, for a caller
+       that has already taken the fields apart */
+    void input_pair(uint8_t b1, uint8_t b2) {
+	int cls = demux_pair(b1, b2);
+
+	if (cls != detail::PAIR_IGNORE && chan_.active == Service)
+	    decode_pair(b1, b2, cls);
+	frame_++;
+    }
+
+    /* input nframes consecutive four-byte frames */
+    void input_batch(const uint8_t* bytes, size_t nframes) {
+	for (size_t i = 0; i < nframes; ++i) {
+	    input(bytes + 4*i);
+	}
+    }
+
+    /* the EIA608_COLUMNS cells of one row of the current screen, good
+       until the next input */
+    const Cell* row(int r) const {
+	return displayed(r);
+    }
+
+    /* a bitmask of the rows of the screen that are different since the
+       last time this was called */
+    unsigned changed_rows() {
+	unsigned rows = dirty_;
+
+	dirty_ = 0;
+	return rows;
+    }
+
+    long frame() const { return frame_; }
+    void set_frame(long frame) { frame_ = frame; }
+    int mode() const { return mode_; }
+    Sink& sink() { return sink_; }
+
+    eia608_stats_t stats() const {
+	eia608_stats_t s = stats_;
+
+	s.chars_front = chars_[0];
+	s.chars_back = chars_[1];
+	s.parity_errors = chan_.parity_errors;
+	s.duplicates = chan_.duplicates;
+	return s;
+    }
+
+private:
+    struct channel {
+	int active;
+	uint8_t last_b1, last_b2;
+	unsigned long parity_errors, duplicates;
+    };
+
+    int x_ = 0, y_ = 0;
+    channel chan_ = {Service & 0x02, 0, 0, 0, 0};
+    int cur_attribute_ = 0;
+    int in_back_ = 0;
+    /* the rows of the screen that writing changes: all of them, or none
+       while writing to the nondisplayed memory */
+    unsigned shown_ = detail::ALL_ROWS;
+    int front_ = 0;
+    Cell memory_[2][EIA608_ROWS][EIA608_COLUMNS] = {};
+    uint8_t rowmap_[2][EIA608_ROWS];
+    int rolluplines_ = 0;
+    unsigned dirty_ = 0;
+    long frame_ = 0;
+    int mode_ = EIA608_MODE_POPON;
+    int cue_open_ = 0, cue_ended_ = 0;
+    unsigned pending_ = 0;
+    eia608_stats_t stats_ = {};
+    unsigned long chars_[2] = {0, 0}; /* to the front and back memories */
+    Sink sink_;
+
+    decoder(const Sink& sink, int) : sink_(sink) {
+	for (int i = 0; i < EIA608_ROWS; ++i) {
+	    rowmap_[0][i] = rowmap_[1][i] = i;
+	}
+    }
+
+    Cell* row_of(int m, int r) { return memory_[m][rowmap_[m][r]]; }
+    const Cell* displayed(int r) const { return memory_[front_][rowmap_[front_][r]]; }
+    Cell* displayed(int r) { return row_of(front_, r); }
+    Cell* nondisplayed(int r) { return row_of(front_ ^ 1, r); }
+    Cell* writing(int r) { return row_of(front_ ^ in_back_, r); }
+
+    static void clear_row(Cell* row) {
+	for (int j = 0; j < EIA608_COLUMNS; ++j) {
+	    row[j] = Cell();
+	}
+    }
+
+    static bool same_row(const Cell* a, const Cell* b) {
+	if constexpr (std::has_unique_object_representations<Cell>::value) {
+	    return std::memcmp(a, b, sizeof(Cell) * EIA608_COLUMNS) == 0;
+	} else {
+	    for (int j = 0; j < EIA608_COLUMNS; ++j) {
+		if (a[j].ch != b[j].ch || a[j].attr != b[j].attr)
+		    return false;
+	    }
+	    return true;
+	}
+    }
+
+    static bool blank_row(const Cell* row) {
+	static const Cell blank[EIA608_COLUMNS] = {};
+
+	return same_row(row, blank);
+    }
+
+    void rows_changed(unsigned rows) {
+	dirty_ |= rows;
+	if constexpr (has_events)
+	    pending_ |= rows;
+    }
+
+    void emit(int type, int row) {
+	sink_(event<Cell>{type, frame_, mode_, row, row >= 0 ? displayed(row) : nullptr});
+    }
+
+    unsigned content_rows() const {
+	unsigned rows = 0;
+
+	for (int i = 0; i < EIA608_ROWS; ++i) {
+	    if (!blank_row(displayed(i)))
+		rows |= detail::row_bit(i);
+	}
+	return rows;
+    }
+
+    void end_cue() {
+	if constexpr (has_events) {
+	    if (cue_open_) {
+		emit(EIA608_EVENT_CUE_END, -1);
+		cue_open_ = 0;
+		cue_ended_ = 1;
+	    }
+	}
+    }
+
+    void flush_events() {
+	unsigned rows = pending_;
+
+	pending_ = 0;
+	if (!cue_open_) {
+	    if (!rows && !cue_ended_)
+		return;
+	    cue_ended_ = 0;
+	    rows = content_rows();
+	    if (!rows)
+		return;
+	    emit(EIA608_EVENT_CUE_START, -1);
+	    cue_open_ = 1;
+	}
+
+	for (int i = 0; rows; ++i) {
+	    if (rows & detail::row_bit(i)) {
+		emit(EIA608_EVENT_ROW, i);
+		rows &= ~detail::row_bit(i);
+	    }
+	}
+    }
+
+    void set_mode(int mode) {
+	if (mode_ != mode) {
+	    mode_ = mode;
+	    if constexpr (has_events)
+		emit(EIA608_EVENT_MODE, -1);
+	}
+    }
+
+    /* where the character goes decides nothing but which memory and
+       counter; the screen only changes if it's the displayed one */
+    void append_char(char16_t ch) {
+	Cell& cell = writing(x_)[y_];
+
+	cell.ch = ch;
+	cell.attr = cur_attribute_;
+	rows_changed(detail::row_bit(x_) & shown_);
+	chars_[in_back_]++;
+	y_ += y_ < EIA608_COLUMNS - 1;
+    }
+
+    void set_in_back(int in_back) {
+	in_back_ = in_back;
+	shown_ = in_back ? 0 : detail::ALL_ROWS;
+    }
+
+    void backspace() {
+	if (y_ > 0)
+	    y_--;
+    }
+
+    int rollup_lines(int row) const {
+	int lines = rolluplines_;
+
+	if (lines > row + 1)
+	    lines = row + 1;
+	if (lines < 1)
+	    lines = 1;
+	return lines;
+    }
+
+    void carriage_return() {
+	uint8_t* map = rowmap_[front_];
+	int row = x_;
+	int top = row - rollup_lines(row) + 1;
+	uint8_t gone = map[top];
+
+	end_cue();
+	for (int i = top; i < row; ++i) {
+	    map[i] = map[i + 1];
+	}
+	map[row] = gone;
+	clear_row(memory_[front_][gone]);
+	y_ = 0;
+	rows_changed((detail::row_bit(row + 1) - 1) & ~(detail::row_bit(top) - 1));
+    }
+
+    void move_rollup(int from, int to) {
+	uint8_t* map = rowmap_[front_];
+	uint8_t moving[EIA608_ROWS], freed[EIA608_ROWS];
+	unsigned lost = 0, src = 0, dst = 0;
+	int lines = rollup_lines(from);
+	int i, k, nfreed = 0;
+
+	for (k = to + 1; k < lines; ++k) {
+	    clear_row(row_of(front_, from - k));
+	    lost |= detail::row_bit(from - k);
+	}
+	if (lines > to + 1)
+	    lines = to + 1;
+
+	for (k = 0; k < lines; ++k) {
+	    src |= detail::row_bit(from - k);
+	    dst |= detail::row_bit(to - k);
+	    moving[k] = map[from - k];
+	}
+	for (k = 0; k < lines; ++k) {
+	    if (!(src & detail::row_bit(to - k)))
+		freed[nfreed++] = map[to - k];
+	}
+	for (k = 0; k < lines; ++k) {
+	    map[to - k] = moving[k];
+	}
+	for (i = 0, k = 0; i < EIA608_ROWS; ++i) {
+	    if ((src & ~dst) & detail::row_bit(i)) {
+		map[i] = freed[k++];
+		clear_row(memory_[front_][map[i]]);
+	    }
+	}
+
+	rows_changed(lost | src | dst);
+    }
+
+    void interpret_pac(uint8_t b1, uint8_t b2) {
+	int from = x_;
+
+	x_ = detail::pac_lines[b1 & 0x0f] + ((b2 & 0x20) != 0);
+	if (mode_ == EIA608_MODE_ROLLUP && x_ != from)
+	    move_rollup(from, x_);
+
+	if (b2 & 0x10) {
+	    y_ = (b2 & 0x0E) << 1;
+	    cur_attribute_ = EIA608_WHITE;
+	} else if ((b2 & 0x0E) == 0x0E) {
+	    cur_attribute_ = EIA608_WHITE | EIA608_ITALIC;
+	} else {
+	    cur_attribute_ = (b2 & 0x0E) >> 1;
+	}
+	if (b2 & 0x01)
+	    cur_attribute_ |= EIA608_UNDERLINE;
+    }
+
+    void interpret_attribute(uint8_t attr) {
+	if ((attr & 0xFE) == 0x2E)
+	    cur_attribute_ |= EIA608_ITALIC;
+	else
+	    cur_attribute_ = (attr & 0xf) >> 1;
+	if (attr & 0x1)
+	    cur_attribute_ = EIA608_UNDERLINE;
+    }
+
+    void swap_memories() {
+	unsigned rows = 0;
+
+	for (int i = 0; i < EIA608_ROWS; ++i) {
+	    if (!same_row(displayed(i), nondisplayed(i)))
+		rows |= detail::row_bit(i);
+	}
+
+	end_cue();
+	front_ ^= 1;
+	rows_changed(rows);
+	stats_.swaps++;
+    }
+
+    void interpret_command(uint8_t command) {
+	stats_.commands[command & 0x0F]++;
+
+	switch (command) {
+	case detail::CC_RCL:
+	    set_in_back(1);
+	    set_mode(EIA608_MODE_POPON);
+	    break;
+	case detail::CC_BS:
+	    backspace();
+	    writing(x_)[y_].ch = 0;
+	    rows_changed(detail::row_bit(x_) & shown_);
+	    break;
+	case detail::CC_DER:
+	    for (int j = y_; j < EIA608_COLUMNS; ++j) {
+		writing(x_)[j] = Cell();
+	    }
+	    rows_changed(detail::row_bit(x_) & shown_);
+	    break;
+	case detail::CC_RU2:
+	case detail::CC_RU3:
+	case detail::CC_RU4:
+	    rolluplines_ = command - detail::CC_RU2 + 2;
+	    set_in_back(0);
+	    set_mode(EIA608_MODE_ROLLUP);
+	    if (rolluplines_ > x_)
+		x_ = 14;
+	    break;
+	case detail::CC_RDC:
+	    set_in_back(0);
+	    set_mode(EIA608_MODE_PAINTON);
+	    break;
+	case detail::CC_TR:
+	    set_in_back(0);
+	    rolluplines_ = 15;
+	    set_mode(EIA608_MODE_TEXT);
+	    interpret_pac(0x14, 0x60);
+	    break;
+	case detail::CC_RTD:
+	    set_mode(EIA608_MODE_TEXT);
+	    break;
+	case detail::CC_EDM:
+	    end_cue();
+	    for (int i = 0; i < EIA608_ROWS; ++i) {
+		clear_row(memory_[front_][i]);
+	    }
+	    rows_changed(detail::ALL_ROWS);
+	    break;
+	case detail::CC_CR:
+	    carriage_return();
+	    break;
+	case detail::CC_ENM:
+	    for (int i = 0; i < EIA608_ROWS; ++i) {
+		clear_row(memory_[front_ ^ 1][i]);
+	    }
+	    break;
+	case detail::CC_EOC:
+	    swap_memories();
+	    break;
+	default:
+	    /* AOF, AON and FON do nothing */
+	    break;
+	}
+    }
+
+    /* demux_pair of eia608.c, taking the parity off b1 and b2 */
+    int demux_pair(uint8_t& b1, uint8_t& b2) {
+	int cls = detail::pair_class.cls[(b1 << 8) | b2];
+
+	if ((cls & detail::PAIR_ACTION) == detail::PAIR_IGNORE) {
+	    if (cls & detail::PAIR_PARITY)
+		chan_.parity_errors++;
+	    return detail::PAIR_IGNORE;
+	}
+
+	b1 &= 0x7f;
+	b2 &= 0x7f;
+
+	if ((cls & detail::PAIR_ACTION) <= detail::PAIR_CHARS) {
+	    chan_.last_b1 = chan_.last_b2 = 0;
+	    return cls;
+	}
+
+	if (b1 == chan_.last_b1 && b2 == chan_.last_b2) {
+	    chan_.last_b1 = chan_.last_b2 = 0;
+	    chan_.duplicates++;
+	    return detail::PAIR_IGNORE;
+	}
+	chan_.last_b1 = b1;
+	chan_.last_b2 = b2;
+
+	if (cls & detail::PAIR_CHAN2) {
+	    chan_.active |= 0x01;
+	    b1 &= ~0x08;
+	} else {
+	    chan_.active &= ~0x01;
+	}
+
+	if (cls & detail::PAIR_TO_CC)
+	    chan_.active &= ~0x10;
+	else if (cls & detail::PAIR_TO_TEXT)
+	    chan_.active |= 0x10;
+
+	return cls;
+    }
+
+    void decode_pair(uint8_t b1, uint8_t b2, int cls) {
+	stats_.pairs++;
+
+	switch (cls & detail::PAIR_ACTION) {
+	case detail::PAIR_CHARS:
+	    append_char(detail::basictab[b1 - 0x20]);
+	    append_char(detail::basictab[b2 - 0x20]);
+	    break;
+	case detail::PAIR_CHAR:
+	    append_char(detail::basictab[b1 - 0x20]);
+	    break;
+	case detail::PAIR_PAC:
+	    stats_.pacs++;
+	    interpret_pac(b1, b2);
+	    break;
+	case detail::PAIR_EXT1:
+	    append_char(detail::exttab1[b2 - 0x30]);
+	    break;
+	case detail::PAIR_EXT2:
+	    backspace();
+	    append_char(detail::exttab2[b2 - 0x20]);
+	    break;
+	case detail::PAIR_EXT3:
+	    backspace();
+	    append_char(detail::exttab3[b2 - 0x20]);
+	    break;
+	case detail::PAIR_ATTR:
+	    interpret_attribute(b2);
+	    break;
+	case detail::PAIR_TAB:
+	    y_ += b2 & 0x03;
+	    if (y_ > EIA608_COLUMNS - 1)
+		y_ = EIA608_COLUMNS - 1;
+	    break;
+	case detail::PAIR_CMD:
+	    interpret_command(b2);
+	    break;
+	}
+
+	if constexpr (has_events)
+	    flush_events();
+    }
+};
+
+} /* namespace eia608 */
+
+#endif /* ndef __EIA608_HPP */
+
+/*
+ * Local variables:
+ *  coding: utf-8
+ * End:
+ */
@@ -0,0 +1,155 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _XOPEN_SOURCE_EXTENDED
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "monitor.h"
+
+/* a pane is the screen with a border round it, the title on the top */
+#define PANE_HEIGHT (EIA608_ROWS + 2)
+#define PANE_WIDTH  (EIA608_COLUMNS + 2)
+#define STATUS_MAX  256
+
+typedef struct {
+    WINDOW* win; /* NULL if it doesn't fit */
+    eia608_t* decoder;
+} pane_t;
+
+struct __monitor_struct {
+    int npanes, shown;
+    pane_t* panes;
+    char status[STATUS_MAX];
+};
+
+monitor_t* monitor_new(int npanes) {
+    monitor_t* monitor = malloc(sizeof(monitor_t));
+    int across, down, i;
+
+    if (!monitor)
+	return NULL;
+    memset(monitor, 0, sizeof(monitor_t));
+    monitor->panes = calloc(npanes, sizeof(pane_t));
+    if (!monitor->panes) {
+	free(monitor);
+	return NULL;
+    }
+    monitor->npanes = npanes;
+
+    /* below the status line, as many across and down as will fit */
+    across = COLS / PANE_WIDTH;
+    down = (LINES - 1) / PANE_HEIGHT;
+    for (i = 0; i < npanes && i < across * down; ++i) {
+	monitor->panes[i].win = newwin(PANE_HEIGHT, PANE_WIDTH,
+				       1 + (i / across) * PANE_HEIGHT,
+				       (i % across) * PANE_WIDTH);
+	if (!monitor->panes[i].win)
+	    break;
+	box(monitor->panes[i].win, 0, 0);
+	monitor->shown++;
+    }
+
+    return monitor;
+}
+
+void monitor_free(monitor_t* monitor) {
+    int i;
+
+    for (i = 0; i < monitor->shown; ++i) {
+	delwin(monitor->panes[i].win);
+    }
+    free(monitor->panes);
+    free(monitor);
+}
+
+int monitor_shown(monitor_t* monitor) {
+    return monitor->shown;
+}
+
+void monitor_set_pane(monitor_t* monitor, int pane, const char* title, eia608_t* decoder) {
+    pane_t* p = &monitor->panes[pane];
+    int row;
+
+    p->decoder = decoder;
+    if (!p->win)
+	return;
+
+    /* start with the whole screen; after this only changes are drawn */
+    eia608_get_changed_rows(decoder);
+    mvwaddnstr(p->win, 0, 1, title, EIA608_COLUMNS);
+    for (row = 0; row < EIA608_ROWS; ++row) {
+	monitor_draw_row(p->win, row + 1, 1, eia608_get_row(decoder, row));
+    }
+    wnoutrefresh(p->win);
+}
+
+void monitor_render(monitor_t* monitor, const char* status) {
+    pane_t* p;
+    unsigned rows;
+    int dirty = 0;
+    int i, row;
+
+    if (strncmp(status, monitor->status, STATUS_MAX - 1) != 0) {
+	strncpy(monitor->status, status, STATUS_MAX - 1);
+	move(0, 0);
+	clrtoeol();
+	addnstr(status, COLS);
+	wnoutrefresh(stdscr);
+	dirty = 1;
+    }
+
+    for (i = 0; i < monitor->shown; ++i) {
+	p = &monitor->panes[i];
+	if (!p->decoder)
+	    continue;
+	rows = eia608_get_changed_rows(p->decoder);
+	if (!rows)
+	    continue;
+	for (row = 0; rows; ++row, rows >>= 1) {
+	    if (rows & 1)
+		monitor_draw_row(p->win, row + 1, 1, eia608_get_row(p->decoder, row));
+	}
+	wnoutrefresh(p->win);
+	dirty = 1;
+    }
+
+    if (dirty)
+	doupdate();
+}
+
+void monitor_draw_row(WINDOW* win, int y, int x, const eia608_cell_t* row) {
+    cchar_t wch;
+    int j;
+
+    wmove(win, y, x);
+    for (j = 0; j < EIA608_COLUMNS; ++j) {
+	wchar_t ch = row[j].ch;
+	int a = row[j].attr;
+	wch.chars[0] = ch == 0 ? L' ' : ch;
+	wch.chars[1] = 0;
+	wch.attr = COLOR_PAIR((a & 0x7) + 1);
+	if (a & EIA608_UNDERLINE)
+	    wch.attr |= A_UNDERLINE;
+	if (a & EIA608_ITALIC)
+	    wch.attr |= A_STANDOUT; /* curses doesn't have italics */
+	wadd_wch(win, &wch);
+    }
+}
@@ -0,0 +1,51 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __MONITOR_H
+#define __MONITOR_H
+
+#include <curses.h>
+
+#include "eia608.h"
+
+/* a grid of panes on the terminal, each showing the screen of one decoder
+   under a title, with a status line across the top */
+typedef struct __monitor_struct monitor_t;
+
+/* lay out npanes panes; curses has to be started already.  panes that
+   don't fit on the terminal aren't shown. */
+monitor_t* monitor_new(int npanes);
+void monitor_free(monitor_t* monitor);
+
+/* how many of the panes fit */
+int monitor_shown(monitor_t* monitor);
+
+/* have a pane show a decoder's screen.  the monitor reads the decoder's
+   changed rows, so nothing else should. */
+void monitor_set_pane(monitor_t* monitor, int pane, const char* title, eia608_t* decoder);
+
+/* bring the terminal up to date: redraw only the rows that changed in
+   each pane since last time, and the status line if it changed.  costs
+   next to nothing when nothing changed. */
+void monitor_render(monitor_t* monitor, const char* status);
+
+/* draw the EIA608_COLUMNS cells of a row at y, x in a window */
+void monitor_draw_row(WINDOW* win, int y, int x, const eia608_cell_t* row);
+
+#endif /* ndef __MONITOR_H */
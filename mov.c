@@ -0,0 +1,384 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Just enough of the QuickTime file format to find the DV frames: the
+ * moov atom is read once, and the sample-to-chunk, sample size and chunk
+ * offset tables of the DV track are turned into a frame offset table.
+ */
+
+#define _LARGEFILE64_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "mov.h"
+
+#define FOURCC(a,b,c,d) (((uint32_t)(a) << 24) | ((b) << 16) | ((c) << 8) | (d))
+
+/* the biggest moov atom read; a few hours of DV index in well under this */
+#define MAX_MOOV (256 << 20)
+
+/* codecs libquicktime calls DV */
+static const char* dv_codecs[] = {
+    "dvc ", "dvcp", "dvpp", "dv5n", "dv5p", "AVdv", "AVd1", NULL
+};
+
+struct __mov_struct {
+    char codec[5];
+    long nframes;
+    uint64_t* offsets;
+    uint32_t* sizes;   /* NULL if every frame is the same size */
+    uint32_t size;
+};
+
+/* the pieces of a track that matter */
+typedef struct {
+    int video;
+    char codec[5];
+    const uint8_t *stsz, *stsc, *stco, *co64;
+    uint32_t stsz_len, stsc_len, stco_len, co64_len;
+} track_t;
+
+static inline uint32_t be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline uint64_t be64(const uint8_t* p) {
+    return ((uint64_t)be32(p) << 32) | be32(p + 4);
+}
+
+/* find the header of the atom at p within [p, end); returns its payload
+   and sets *type and *len, or returns NULL if it doesn't fit */
+static const uint8_t* atom(const uint8_t* p, const uint8_t* end,
+			   uint32_t* type, uint64_t* len) {
+    uint64_t size;
+    int header = 8;
+
+    if (end - p < 8)
+	return NULL;
+    size = be32(p);
+    *type = be32(p + 4);
+    if (size == 1) {
+	if (end - p < 16)
+	    return NULL;
+	size = be64(p + 8);
+	header = 16;
+    } else if (size == 0) {
+	size = end - p;
+    }
+    if (size < (uint64_t)header || size > (uint64_t)(end - p))
+	return NULL;
+
+    *len = size - header;
+    return p + header;
+}
+
+/* walk the atoms in [p, end), descending into the containers on the way
+   to the sample table, and fill in t */
+static void scan_track(const uint8_t* p, const uint8_t* end, track_t* t) {
+    const uint8_t* body;
+    uint32_t type;
+    uint64_t len;
+
+    while ((body = atom(p, end, &type, &len)) != NULL) {
+	switch (type) {
+	case FOURCC('m','d','i','a'):
+	case FOURCC('m','i','n','f'):
+	case FOURCC('s','t','b','l'):
+	    scan_track(body, body + len, t);
+	    break;
+	case FOURCC('h','d','l','r'):
+	    /* version/flags, component type, then subtype */
+	    if (len >= 12 && be32(body + 8) == FOURCC('v','i','d','e'))
+		t->video = 1;
+	    break;
+	case FOURCC('s','t','s','d'):
+	    /* version/flags, count, then the first entry: size, format */
+	    if (len >= 16) {
+		memcpy(t->codec, body + 12, 4);
+		t->codec[4] = '\0';
+	    }
+	    break;
+	case FOURCC('s','t','s','z'):
+	    t->stsz = body;
+	    t->stsz_len = len;
+	    break;
+	case FOURCC('s','t','s','c'):
+	    t->stsc = body;
+	    t->stsc_len = len;
+	    break;
+	case FOURCC('s','t','c','o'):
+	    t->stco = body;
+	    t->stco_len = len;
+	    break;
+	case FOURCC('c','o','6','4'):
+	    t->co64 = body;
+	    t->co64_len = len;
+	    break;
+	}
+	p = body + len;
+    }
+}
+
+static int is_dv(const char* codec) {
+    int i;
+
+    for (i = 0; dv_codecs[i]; ++i) {
+	if (strcmp(codec, dv_codecs[i]) == 0)
+	    return 1;
+    }
+    return 0;
+}
+
+/* the offset of a chunk */
+static uint64_t chunk_offset(track_t* t, uint32_t chunk) {
+    return t->co64 ? be64(t->co64 + 8 + 8*chunk) : be32(t->stco + 8 + 4*chunk);
+}
+
+/* how many of a chunk's samples to believe in: with one size for every
+   sample, only as many as fit between the chunk and the end of the file */
+static uint32_t chunk_samples(mov_t* mov, track_t* t, uint32_t chunk, uint32_t samples,
+			      uint64_t filesize) {
+    uint64_t offset = chunk_offset(t, chunk);
+    uint64_t room;
+
+    if (mov->sizes || mov->size == 0)
+	return samples;
+    room = offset < filesize ? (filesize - offset) / mov->size : 0;
+    return room < samples ? room : samples;
+}
+
+/* turn the track's tables into the frame offset table, for a file of
+   filesize bytes */
+static const char* build_index(mov_t* mov, track_t* t, uint64_t filesize) {
+    uint32_t nchunks, nentries, entry, chunk;
+    long i = 0;
+    uint64_t offset, located;
+    uint32_t samples, n;
+
+    if (!t->stsz || t->stsz_len < 12 || !t->stsc || t->stsc_len < 8 ||
+	(!t->stco && !t->co64))
+	return "missing sample tables";
+
+    /* stsz: version/flags, sample size, count, [sizes] */
+    mov->size = be32(t->stsz + 4);
+    mov->nframes = be32(t->stsz + 8);
+    if (mov->size == 0) {
+	if ((t->stsz_len - 12) / 4 < (uint64_t)mov->nframes)
+	    return "truncated sample size table";
+	mov->sizes = malloc(mov->nframes * sizeof(uint32_t));
+	if (!mov->sizes)
+	    return "out of memory";
+	for (i = 0; i < mov->nframes; ++i) {
+	    mov->sizes[i] = be32(t->stsz + 12 + 4*i);
+	}
+    }
+
+    /* stco/co64: version/flags, count, offsets */
+    if (t->co64) {
+	nchunks = t->co64_len >= 8 ? be32(t->co64 + 4) : 0;
+	if ((t->co64_len - 8) / 8 < nchunks)
+	    return "truncated chunk offset table";
+    } else {
+	nchunks = t->stco_len >= 8 ? be32(t->stco + 4) : 0;
+	if ((t->stco_len - 8) / 4 < nchunks)
+	    return "truncated chunk offset table";
+    }
+
+    /* stsc: version/flags, count, {first chunk, samples per chunk, id} */
+    nentries = be32(t->stsc + 4);
+    if ((t->stsc_len - 8) / 12 < nentries)
+	return "truncated sample-to-chunk table";
+
+    /* no more frames than the chunks can locate, whatever stsz says, so
+       a tiny file can't ask for gigabytes */
+    located = 0;
+    for (entry = 0; entry < nentries && located < (uint64_t)mov->nframes; ++entry) {
+	const uint8_t* e = t->stsc + 8 + 12*entry;
+	uint32_t first = be32(e) - 1;
+	uint32_t last = entry + 1 < nentries ? be32(e + 12) - 1 : nchunks;
+
+	samples = be32(e + 4);
+	for (chunk = first; chunk < last && chunk < nchunks &&
+		 located < (uint64_t)mov->nframes; ++chunk) {
+	    located += chunk_samples(mov, t, chunk, samples, filesize);
+	}
+    }
+    if (located < (uint64_t)mov->nframes)
+	mov->nframes = located;
+
+    mov->offsets = malloc(mov->nframes * sizeof(uint64_t));
+    if (!mov->offsets && mov->nframes > 0)
+	return "out of memory";
+
+    i = 0;
+    for (entry = 0; entry < nentries && i < mov->nframes; ++entry) {
+	const uint8_t* e = t->stsc + 8 + 12*entry;
+	uint32_t first = be32(e) - 1;
+	uint32_t last = entry + 1 < nentries ? be32(e + 12) - 1 : nchunks;
+
+	samples = be32(e + 4);
+	for (chunk = first; chunk < last && chunk < nchunks && i < mov->nframes; ++chunk) {
+	    offset = chunk_offset(t, chunk);
+	    n = chunk_samples(mov, t, chunk, samples, filesize);
+	    for (; n > 0 && i < mov->nframes; --n, ++i) {
+		mov->offsets[i] = offset;
+		offset += mov->sizes ? mov->sizes[i] : mov->size;
+	    }
+	}
+    }
+
+    /* trust only the frames the tables actually locate */
+    mov->nframes = i;
+    return NULL;
+}
+
+mov_t* mov_open(int fd, const char** error) {
+    uint8_t header[16];
+    uint8_t* moov = NULL;
+    const uint8_t* body;
+    const uint8_t* p;
+    uint32_t type;
+    uint64_t len, pos = 0;
+    track_t t;
+    mov_t* mov;
+    struct stat64 st;
+    uint64_t filesize = 0;
+    int first = 1;
+
+    *error = NULL;
+    if (fstat64(fd, &st) == 0)
+	filesize = st.st_size;
+
+    /* find the moov atom among the top-level atoms */
+    for (;;) {
+	ssize_t got = pread64(fd, header, sizeof(header), pos);
+	uint64_t size;
+	int hlen = 8;
+
+	if (got < 8)
+	    break;
+	size = be32(header);
+	type = be32(header + 4);
+	if (size == 1 && got == 16) {
+	    size = be64(header + 8);
+	    hlen = 16;
+	}
+
+	/* don't mistake anything else for QuickTime */
+	if (first) {
+	    switch (type) {
+	    case FOURCC('f','t','y','p'):
+	    case FOURCC('m','o','o','v'):
+	    case FOURCC('m','d','a','t'):
+	    case FOURCC('w','i','d','e'):
+	    case FOURCC('f','r','e','e'):
+	    case FOURCC('s','k','i','p'):
+	    case FOURCC('p','n','o','t'):
+		break;
+	    default:
+		return NULL;
+	    }
+	    first = 0;
+	}
+
+	if (size < (uint64_t)hlen)
+	    break;
+	if (type == FOURCC('m','o','o','v')) {
+	    len = size - hlen;
+	    /* the size is only what the file says, so check it before
+	       allocating that much */
+	    if (len > MAX_MOOV || (filesize && len > filesize - pos - hlen)) {
+		*error = "moov atom is too big";
+		return NULL;
+	    }
+	    moov = malloc(len);
+	    if (!moov || pread64(fd, moov, len, pos + hlen) != (ssize_t)len) {
+		free(moov);
+		*error = "couldn't read moov atom";
+		return NULL;
+	    }
+	    break;
+	}
+	pos += size;
+    }
+
+    if (!moov) {
+	if (!first)
+	    *error = "no moov atom";
+	return NULL;
+    }
+
+    /* the first DV video track wins */
+    mov = NULL;
+    p = moov;
+    while ((body = atom(p, moov + len, &type, &pos)) != NULL) {
+	if (type == FOURCC('t','r','a','k')) {
+	    memset(&t, 0, sizeof(t));
+	    scan_track(body, body + pos, &t);
+	    if (t.video && is_dv(t.codec)) {
+		mov = calloc(1, sizeof(mov_t));
+		if (!mov) {
+		    *error = "out of memory";
+		    break;
+		}
+		memcpy(mov->codec, t.codec, sizeof(mov->codec));
+		*error = build_index(mov, &t, filesize);
+		if (*error) {
+		    mov_free(mov);
+		    mov = NULL;
+		}
+		break;
+	    }
+	}
+	p = body + pos;
+    }
+
+    if (!mov && !*error)
+	*error = "no DV video track";
+
+    free(moov);
+    return mov;
+}
+
+void mov_free(mov_t* mov) {
+    free(mov->offsets);
+    free(mov->sizes);
+    free(mov);
+}
+
+const char* mov_codec(mov_t* mov) {
+    return mov->codec;
+}
+
+long mov_frames(mov_t* mov) {
+    return mov->nframes;
+}
+
+uint64_t mov_frame_offset(mov_t* mov, long i) {
+    return mov->offsets[i];
+}
+
+uint32_t mov_frame_size(mov_t* mov, long i) {
+    return mov->sizes ? mov->sizes[i] : mov->size;
+}
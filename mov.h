@@ -0,0 +1,44 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __MOV_H
+#define __MOV_H
+
+#include <inttypes.h>
+
+typedef struct __mov_struct mov_t;
+
+/* read the sample tables of the DV video track of a QuickTime file.
+   returns NULL if fd isn't a QuickTime file or has no DV video track;
+   *error is then set if it looked like QuickTime but was no good. */
+mov_t* mov_open(int fd, const char** error);
+
+void mov_free(mov_t* mov);
+
+/* the video codec's four character code, e.g. "dvc " */
+const char* mov_codec(mov_t* mov);
+
+/* number of frames in the DV track */
+long mov_frames(mov_t* mov);
+
+/* where frame i is in the file, and how big it is */
+uint64_t mov_frame_offset(mov_t* mov, long i);
+uint32_t mov_frame_size(mov_t* mov, long i);
+
+#endif /* ndef __MOV_H */
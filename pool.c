@@ -0,0 +1,139 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "pool.h"
+
+/* the jobs a worker still has to do, as the range [head, tail).  the owner
+   takes jobs from the tail and thieves take them from the head. */
+typedef struct {
+    pthread_mutex_t lock;
+    long head, tail;
+} deque_t;
+
+typedef struct {
+    pool_job_fn fn;
+    void* data;
+    int nthreads;
+    deque_t* deques;
+} pool_t;
+
+typedef struct {
+    pool_t* pool;
+    int id;
+} worker_t;
+
+static long take_own(deque_t* d) {
+    long job = -1;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->head < d->tail)
+	job = --d->tail;
+    pthread_mutex_unlock(&d->lock);
+
+    return job;
+}
+
+static long steal(deque_t* d) {
+    long job = -1;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->head < d->tail)
+	job = d->head++;
+    pthread_mutex_unlock(&d->lock);
+
+    return job;
+}
+
+static void* work(void* arg) {
+    worker_t* w = (worker_t*)arg;
+    pool_t* pool = w->pool;
+    long job;
+    int i;
+
+    for (;;) {
+	job = take_own(&pool->deques[w->id]);
+
+	/* out of work: look for a victim, starting with the next thread */
+	for (i = 1; job < 0 && i < pool->nthreads; ++i) {
+	    job = steal(&pool->deques[(w->id + i) % pool->nthreads]);
+	}
+
+	/* jobs are never added, so if nobody had one we're done */
+	if (job < 0)
+	    break;
+
+	pool->fn(pool->data, job, w->id);
+    }
+
+    return NULL;
+}
+
+int pool_run(long njobs, int nthreads, pool_job_fn fn, void* data) {
+    pool_t pool;
+    pthread_t* threads;
+    worker_t* workers;
+    int i, started;
+
+    if (nthreads < 1)
+	nthreads = 1;
+    if (nthreads > njobs)
+	nthreads = njobs > 0 ? njobs : 1;
+
+    pool.fn = fn;
+    pool.data = data;
+    pool.nthreads = nthreads;
+    pool.deques = (deque_t*)malloc(nthreads * sizeof(deque_t));
+    threads = (pthread_t*)malloc(nthreads * sizeof(pthread_t));
+    workers = (worker_t*)malloc(nthreads * sizeof(worker_t));
+    if (!pool.deques || !threads || !workers) {
+	free(pool.deques);
+	free(threads);
+	free(workers);
+	return -1;
+    }
+
+    for (i = 0; i < nthreads; ++i) {
+	pthread_mutex_init(&pool.deques[i].lock, NULL);
+	pool.deques[i].head = njobs * i / nthreads;
+	pool.deques[i].tail = njobs * (i + 1) / nthreads;
+	workers[i].pool = &pool;
+	workers[i].id = i;
+    }
+
+    /* a thread that fails to start leaves its jobs to be stolen */
+    for (started = 0, i = 0; i < nthreads; ++i) {
+	if (pthread_create(&threads[started], NULL, work, &workers[i]) == 0)
+	    started++;
+    }
+    for (i = 0; i < started; ++i) {
+	pthread_join(threads[i], NULL);
+    }
+
+    for (i = 0; i < nthreads; ++i) {
+	pthread_mutex_destroy(&pool.deques[i].lock);
+    }
+    free(pool.deques);
+    free(threads);
+    free(workers);
+
+    return started > 0 ? 0 : -1;
+}
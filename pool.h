@@ -0,0 +1,33 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __POOL_H
+#define __POOL_H
+
+/* run job number `job' on thread number `worker' */
+typedef void (*pool_job_fn)(void* data, long job, int worker);
+
+/* run jobs 0 to njobs-1 on nthreads threads and wait for them all.  each
+   thread starts with an equal share of the jobs and, once it runs out,
+   steals from the threads that still have some, so a few long jobs don't
+   hold everything else up.  returns 0, or -1 if no thread could be
+   started. */
+int pool_run(long njobs, int nthreads, pool_job_fn fn, void* data);
+
+#endif /* ndef __POOL_H */
@@ -0,0 +1,90 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ring.h"
+
+/* keep the two ends' indices on cache lines of their own, so that the
+   producer and consumer don't keep taking the line from each other */
+#define CACHE_LINE 64
+
+struct __ring_struct {
+    size_t mask, elemsize;
+    unsigned char* elems;
+    _Alignas(CACHE_LINE) atomic_size_t head; /* next to pop; the consumer's */
+    _Alignas(CACHE_LINE) atomic_size_t tail; /* next to push; the producer's */
+};
+
+ring_t* ring_new(size_t nelems, size_t elemsize) {
+    ring_t* ring;
+    size_t size = 1;
+
+    while (size < nelems) {
+	size <<= 1;
+    }
+
+    ring = aligned_alloc(CACHE_LINE, sizeof(ring_t));
+    if (!ring)
+	return NULL;
+    ring->elems = malloc(size * elemsize);
+    if (!ring->elems) {
+	free(ring);
+	return NULL;
+    }
+    ring->mask = size - 1;
+    ring->elemsize = elemsize;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+
+    return ring;
+}
+
+void ring_free(ring_t* ring) {
+    free(ring->elems);
+    free(ring);
+}
+
+int ring_push(ring_t* ring, const void* elem) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (tail - head > ring->mask)
+	return -1;
+
+    memcpy(ring->elems + (tail & ring->mask) * ring->elemsize, elem, ring->elemsize);
+    /* the element has to be there before the consumer can see it is */
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return 0;
+}
+
+int ring_pop(ring_t* ring, void* elem) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head == tail)
+	return -1;
+
+    memcpy(elem, ring->elems + (head & ring->mask) * ring->elemsize, ring->elemsize);
+    /* and it has to be copied out before the producer can reuse the slot */
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return 0;
+}
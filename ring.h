@@ -0,0 +1,38 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __RING_H
+#define __RING_H
+
+#include <stddef.h>
+
+/* a bounded queue of fixed-size elements between exactly one producer
+   thread and one consumer thread, needing no locks */
+typedef struct __ring_struct ring_t;
+
+/* room for at least nelems elements of elemsize bytes */
+ring_t* ring_new(size_t nelems, size_t elemsize);
+void ring_free(ring_t* ring);
+
+/* copy an element in, or out.  neither waits: they return 0, or -1 if
+   the ring is full or empty respectively. */
+int ring_push(ring_t* ring, const void* elem);
+int ring_pop(ring_t* ring, void* elem);
+
+#endif /* ndef __RING_H */
@@ -0,0 +1,216 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Primary reference:
+ * the Scenarist SCC format as described at
+ * http://www.theneitherworld.com/mcpoodle/SCC_TOOLS/DOCS/SCC_FORMAT.HTML
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "scc.h"
+#include "smpte.h"
+
+#define SCC_HEADER "Scenarist_SCC V1.0"
+
+struct __scc_reader_struct {
+    FILE* in;
+    char* line;
+    size_t size;
+    long lineno;
+    int started;         /* the header has been read */
+    const char* word;    /* the next word of the line, or NULL for none */
+    long next;           /* the frame the next word is for */
+    smpte_t df, ndf;
+    char error[80];
+};
+
+struct __scc_writer_struct {
+    FILE* out;
+    long next;           /* the frame that would carry on the line */
+    int in_line;
+    smpte_t tc;
+};
+
+scc_reader_t* scc_reader_new(FILE* in) {
+    scc_reader_t* reader = calloc(1, sizeof(scc_reader_t));
+
+    reader->in = in;
+    reader->next = -1;
+    /* SCC is always 29.97; the timecode says whether it drops frames */
+    smpte_init(&reader->df, 1, 30);
+    smpte_init(&reader->ndf, 0, 30);
+    return reader;
+}
+
+void scc_reader_free(scc_reader_t* reader) {
+    free(reader->line);
+    free(reader);
+}
+
+const char* scc_reader_error(scc_reader_t* reader) {
+    return reader->error;
+}
+
+static long fail(scc_reader_t* reader, const char* why) {
+    snprintf(reader->error, sizeof(reader->error), "line %ld: %s", reader->lineno, why);
+    return -1;
+}
+
+static inline int hex(char c) {
+    if (c >= '0' && c <= '9')
+	return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f')
+	return c - 'a' + 10;
+    return -1;
+}
+
+/* move on to the next line with words on it, and find the frame its
+   first word is for.  returns 1, 0 at the end, or -1 on an error. */
+static int next_line(scc_reader_t* reader, long* frame) {
+    char tc[SMPTE_STR_LEN];
+    smpte_t* smpte;
+    ssize_t len;
+    char* p;
+
+    for (;;) {
+	len = getline(&reader->line, &reader->size, reader->in);
+	if (len < 0)
+	    return 0;
+	reader->lineno++;
+
+	while (len > 0 && (reader->line[len-1] == '\n' || reader->line[len-1] == '\r'))
+	    reader->line[--len] = '\0';
+	p = reader->line;
+	if (reader->lineno == 1 && strncmp(p, "\xEF\xBB\xBF", 3) == 0)
+	    p += 3;
+	if (*p == '\0')
+	    continue;
+
+	if (!reader->started) {
+	    if (strcmp(p, SCC_HEADER) != 0)
+		return fail(reader, "no " SCC_HEADER " header");
+	    reader->started = 1;
+	    continue;
+	}
+
+	/* HH:MM:SS:FF or HH:MM:SS;FF, then a tab */
+	len = strcspn(p, " \t");
+	if (len != SMPTE_STR_LEN - 1)
+	    return fail(reader, "expected a timecode");
+	memcpy(tc, p, len);
+	tc[len] = '\0';
+	smpte = (tc[8] == ':' ? &reader->ndf : &reader->df);
+	if (smpte_parse(smpte, tc) != 0)
+	    return fail(reader, "bad timecode");
+	*frame = smpte_get_frame(smpte);
+
+	reader->word = p + len;
+	return 1;
+    }
+}
+
+long scc_read(scc_reader_t* reader, uint8_t* bytes, long max, long* first) {
+    const char* p;
+    long n = 0, frame;
+    int ret, a, b, c, d;
+
+    while (n < max) {
+	if (!reader->word) {
+	    ret = next_line(reader, &frame);
+	    if (ret < 0)
+		return -1;
+	    if (ret == 0)
+		break;
+	    /* a gap ends the run, to be started again on the next call */
+	    if (frame > reader->next) {
+		if (n > 0) {
+		    reader->next = frame;
+		    return n;
+		}
+		reader->next = frame;
+	    }
+	}
+
+	p = reader->word + strspn(reader->word, " \t");
+	if (*p == '\0') {
+	    reader->word = NULL;
+	    continue;
+	}
+	if (n == 0)
+	    *first = reader->next;
+
+	a = hex(p[0]);
+	b = a < 0 ? -1 : hex(p[1]);
+	c = b < 0 ? -1 : hex(p[2]);
+	d = c < 0 ? -1 : hex(p[3]);
+	if (d < 0 || (p[4] != '\0' && p[4] != ' ' && p[4] != '\t'))
+	    return fail(reader, "expected a hex word");
+	bytes[0] = a << 4 | b;
+	bytes[1] = c << 4 | d;
+	bytes[2] = 0x80;
+	bytes[3] = 0x80;
+	bytes += 4;
+	n++;
+	reader->next++;
+	reader->word = p + 4;
+    }
+
+    return n;
+}
+
+scc_writer_t* scc_writer_new(FILE* out) {
+    scc_writer_t* writer = calloc(1, sizeof(scc_writer_t));
+
+    writer->out = out;
+    smpte_init(&writer->tc, 1, 30);
+    fputs(SCC_HEADER "\n", out);
+    return writer;
+}
+
+void scc_writer_free(scc_writer_t* writer) {
+    if (writer->in_line)
+	fputc('\n', writer->out);
+    free(writer);
+}
+
+void scc_write(scc_writer_t* writer, long frame, const uint8_t* pair) {
+    char tc[SMPTE_STR_LEN];
+
+    if ((pair[0] & 0x7f) == 0 && (pair[1] & 0x7f) == 0)
+	return;
+
+    if (!writer->in_line || frame != writer->next) {
+	/* a blank line between lines */
+	if (writer->in_line)
+	    fputc('\n', writer->out);
+	smpte_set_frame(&writer->tc, frame);
+	smpte_format(&writer->tc, tc);
+	fprintf(writer->out, "\n%s\t%02x%02x", tc, pair[0], pair[1]);
+	writer->in_line = 1;
+    } else {
+	fprintf(writer->out, " %02x%02x", pair[0], pair[1]);
+    }
+    writer->next = frame + 1;
+}
@@ -0,0 +1,60 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __SCC_H
+#define __SCC_H
+
+#include <inttypes.h>
+#include <stdio.h>
+
+/*
+ * Scenarist SCC files: the byte pairs of field 1 (CC1, CC2, TEXT1 and
+ * TEXT2), one per frame of 29.97 fps video, as hex words after the
+ * timecode of the first.  frames between the lines are padding.
+ */
+
+typedef struct __scc_reader_struct scc_reader_t;
+typedef struct __scc_writer_struct scc_writer_t;
+
+/* read SCC from in, which is left open when the reader is freed */
+scc_reader_t* scc_reader_new(FILE* in);
+void scc_reader_free(scc_reader_t* reader);
+
+/* read up to max consecutive frames into bytes, four bytes a frame as
+   eia608_input takes them, with padding for field 2, and set *first to
+   the frame number of the first of them.  a line that starts later than
+   the one before it ends starts a new run of frames; one that starts
+   earlier carries on where that left off.  returns the number of frames,
+   0 at the end of the file, or -1 if it isn't SCC. */
+long scc_read(scc_reader_t* reader, uint8_t* bytes, long max, long* first);
+
+/* what was wrong with the file when scc_read returned -1 */
+const char* scc_reader_error(scc_reader_t* reader);
+
+/* write SCC to out with drop-frame timecodes; out is left open */
+scc_writer_t* scc_writer_new(FILE* out);
+
+/* finish the last line and free the writer */
+void scc_writer_free(scc_writer_t* writer);
+
+/* write the field 1 pair of a frame; padding isn't written, and frames
+   come in order */
+void scc_write(scc_writer_t* writer, long frame, const uint8_t* pair);
+
+#endif /* ndef __SCC_H */
@@ -19,19 +19,19 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include <stdio.h>
 
 #include "smpte.h"
 
+/* frames skipped at the start of a dropping minute */
+#define DROPPED(s) ((s)->dropframe ? (s)->fps / 15 : 0)
+
 smpte_t* smpte_new(int dropframe, int fps) {
     smpte_t* p = (smpte_t*)malloc(sizeof(smpte_t));
 
     if(!p)
 	return NULL;
 
-    memset(p, 0, sizeof(smpte_t));
-    p->dropframe = dropframe;
-    p->fps = fps;
+    smpte_init(p, dropframe, fps);
 
     return p;
 }
@@ -40,6 +40,40 @@ void smpte_free(smpte_t* smpte) {
     free(smpte);
 }
 
+void smpte_init(smpte_t* smpte, int dropframe, int fps) {
+    memset(smpte, 0, sizeof(smpte_t));
+    smpte->dropframe = dropframe;
+    smpte->fps = fps;
+}
+
+int smpte_init_rate(smpte_t* smpte, int dropframe, int num, int den) {
+    if (den == 1001) {
+	switch (num) {
+	case 24000:
+	    smpte_init(smpte, 0, 24);
+	    return 0;
+	case 30000:
+	case 60000:
+	    smpte_init(smpte, dropframe != 0, num / 1000);
+	    return 0;
+	}
+	return -1;
+    }
+
+    if (den <= 0 || num % den != 0)
+	return -1;
+    switch (num / den) {
+    case 24:
+    case 25:
+    case 30:
+    case 50:
+    case 60:
+	smpte_init(smpte, 0, num / den);
+	return 0;
+    }
+    return -1;
+}
+
 void smpte_incr_frame(smpte_t* smpte) {
     smpte->frames++;
 
@@ -52,7 +86,7 @@ void smpte_incr_frame(smpte_t* smpte) {
 	    smpte->minute++;
 
 	    if (smpte->dropframe && (smpte->minute % 10) != 0) {
-		smpte->frames = 2;
+		smpte->frames = DROPPED(smpte);
 	    }
 
 	    if (smpte->minute == 60) {
@@ -63,11 +97,84 @@ void smpte_incr_frame(smpte_t* smpte) {
     }
 }
 
+void smpte_set_frame(smpte_t* smpte, long frame) {
+    long drop = DROPPED(smpte);
+    long fps = smpte->fps;
+
+    if (frame < 0)
+	frame = 0;
+
+    /* put back the frame numbers skipped so far; every ten minutes
+       nine minutes' worth are dropped */
+    if (drop) {
+	long per_minute = 60*fps - drop;
+	long per_10min = 600*fps - 9*drop;
+	long tens = frame / per_10min;
+	long rest = frame % per_10min;
+
+	frame += 9*drop*tens;
+	if (rest >= drop)
+	    frame += drop * ((rest - drop) / per_minute);
+    }
+
+    smpte->frames = frame % fps;
+    frame /= fps;
+    smpte->second = frame % 60;
+    frame /= 60;
+    smpte->minute = frame % 60;
+    smpte->hour = frame / 60;
+}
+
+long smpte_get_frame(smpte_t* smpte) {
+    long minutes = 60L*smpte->hour + smpte->minute;
+    long frame = (60*minutes + smpte->second) * smpte->fps + smpte->frames;
+
+    return frame - DROPPED(smpte) * (minutes - minutes / 10);
+}
+
+/* read exactly two digits */
+static int digits(const char* str, unsigned short* value) {
+    if (str[0] < '0' || str[0] > '9' || str[1] < '0' || str[1] > '9')
+	return -1;
+    *value = 10*(str[0] - '0') + (str[1] - '0');
+    return 0;
+}
+
+int smpte_parse(smpte_t* smpte, const char* str) {
+    unsigned short h, m, s, f;
+
+    if (strlen(str) != SMPTE_STR_LEN - 1 ||
+	digits(str, &h) || str[2] != ':' ||
+	digits(str + 3, &m) || str[5] != ':' ||
+	digits(str + 6, &s) || !strchr(":;.", str[8]) ||
+	digits(str + 9, &f))
+	return -1;
+    if (m >= 60 || s >= 60 || f >= smpte->fps)
+	return -1;
+    /* dropped frame numbers don't exist */
+    if (f < DROPPED(smpte) && s == 0 && m % 10 != 0)
+	return -1;
+
+    smpte->hour = h;
+    smpte->minute = m;
+    smpte->second = s;
+    smpte->frames = f;
+    return 0;
+}
+
+static inline void two_digits(char* p, unsigned value) {
+    p[0] = '0' + value / 10;
+    p[1] = '0' + value % 10;
+}
+
 int smpte_format(smpte_t* smpte, char* buf) {
-    return snprintf(buf, SMPTE_STR_LEN, "%02hu:%02hu:%02hu%c%02hu",
-		    smpte->hour,
-		    smpte->minute,
-		    smpte->second,
-		    smpte->dropframe ? ';' : ':',
-		    smpte->frames);
+    two_digits(buf, smpte->hour % 100);
+    buf[2] = ':';
+    two_digits(buf + 3, smpte->minute);
+    buf[5] = ':';
+    two_digits(buf + 6, smpte->second);
+    buf[8] = smpte->dropframe ? ';' : ':';
+    two_digits(buf + 9, smpte->frames);
+    buf[11] = '\0';
+    return SMPTE_STR_LEN - 1;
 }
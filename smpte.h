@@ -28,9 +28,33 @@ typedef struct {
 
 #define SMPTE_STR_LEN 12
 
+/* fps is the nominal rate: 24, 25, 30, 50 or 60.  the 1001-divisor rates
+   count frames the same way, except that at 30 and 60 they can drop
+   frames (2 or 4 of them) at the start of every minute but the tenth. */
 smpte_t* smpte_new(int dropframe, int fps);
 void smpte_free(smpte_t* smpte);
+
+/* set up a caller-owned timecode at frame zero, either as for smpte_new
+   or from a rate of num/den frames per second: one of the nominal rates,
+   or 24000/1001, 30000/1001 or 60000/1001.  dropframe says whether to
+   drop frames at the last two, and is ignored at the others.
+   smpte_init_rate returns 0, or -1 for a rate it doesn't know. */
+void smpte_init(smpte_t* smpte, int dropframe, int fps);
+int smpte_init_rate(smpte_t* smpte, int dropframe, int num, int den);
+
 void smpte_incr_frame(smpte_t* smpte);
+
+/* jump straight to the timecode of a frame count, or find the frame count
+   of the current timecode */
+void smpte_set_frame(smpte_t* smpte, long frame);
+long smpte_get_frame(smpte_t* smpte);
+
+/* set the timecode from HH:MM:SS:FF (or ; or . before the frames).
+   returns 0, or -1 if str isn't a timecode at this rate. */
+int smpte_parse(smpte_t* smpte, const char* str);
+
+/* write HH:MM:SS:FF, or HH:MM:SS;FF if dropping frames, and a NUL to buf,
+   which has room for SMPTE_STR_LEN bytes.  returns the length. */
 int smpte_format(smpte_t* smpte, char* buf);
 
 #endif /* ndef __SMPTE_H */
@@ -0,0 +1,162 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "subtitle.h"
+
+struct __subtitle_struct {
+    FILE* out;
+    int format;
+    int rate_num, rate_den;
+    long count;
+    /* the cue being assembled from decoder events */
+    int open;
+    long start;
+    char rows[EIA608_ROWS][EIA608_UTF8_ROW_MAX + 1];
+};
+
+subtitle_t* subtitle_new(FILE* out, int format, int rate_num, int rate_den) {
+    subtitle_t* sub = (subtitle_t*)malloc(sizeof(subtitle_t));
+
+    if (!sub)
+	return NULL;
+
+    memset(sub, 0, sizeof(subtitle_t));
+    sub->out = out;
+    sub->format = format;
+    sub->rate_num = rate_num;
+    sub->rate_den = rate_den;
+
+    if (format == SUBTITLE_VTT)
+	fputs("WEBVTT\n\n", out);
+
+    return sub;
+}
+
+void subtitle_free(subtitle_t* sub) {
+    fflush(sub->out);
+    free(sub);
+}
+
+/* SRT wants 00:00:00,000 and WebVTT wants 00:00:00.000 */
+static void write_time(subtitle_t* sub, long frame) {
+    long long ms = (long long)frame * 1000 * sub->rate_den / sub->rate_num;
+
+    fprintf(sub->out, "%02lld:%02lld:%02lld%c%03lld",
+	    ms / 3600000, (ms / 60000) % 60, (ms / 1000) % 60,
+	    sub->format == SUBTITLE_VTT ? '.' : ',',
+	    ms % 1000);
+}
+
+/* in WebVTT cue text, & and < start markup; > is escaped too, so a
+   caption can't say --> */
+static void write_vtt_text(FILE* out, const char* text) {
+    for (; *text; ++text) {
+	switch (*text) {
+	case '&':
+	    fputs("&amp;", out);
+	    break;
+	case '<':
+	    fputs("&lt;", out);
+	    break;
+	case '>':
+	    fputs("&gt;", out);
+	    break;
+	default:
+	    putc(*text, out);
+	    break;
+	}
+    }
+}
+
+void subtitle_write(subtitle_t* sub, long start, long end, const char* text) {
+    sub->count++;
+
+    if (sub->format == SUBTITLE_SRT)
+	fprintf(sub->out, "%ld\n", sub->count);
+    write_time(sub, start);
+    fputs(" --> ", sub->out);
+    write_time(sub, end);
+    fputc('\n', sub->out);
+    if (sub->format == SUBTITLE_VTT)
+	write_vtt_text(sub->out, text);
+    else
+	fputs(text, sub->out);
+    fputs("\n\n", sub->out);
+}
+
+/* the non-empty rows of the cue as lines, without leading blanks */
+static void cue_text(subtitle_t* sub, char* buf) {
+    char* p = buf;
+    int i;
+
+    for (i = 0; i < EIA608_ROWS; ++i) {
+	const char* row = sub->rows[i];
+
+	while (*row == ' ')
+	    row++;
+	if (*row == '\0')
+	    continue;
+
+	if (p > buf)
+	    *p++ = '\n';
+	p = stpcpy(p, row);
+    }
+    *p = '\0';
+}
+
+static void end_cue(subtitle_t* sub, long end) {
+    char text[EIA608_ROWS * (EIA608_UTF8_ROW_MAX + 1) + 1];
+
+    if (!sub->open)
+	return;
+    sub->open = 0;
+
+    cue_text(sub, text);
+    if (text[0] && end > sub->start)
+	subtitle_write(sub, sub->start, end, text);
+}
+
+void subtitle_event(void* data, const eia608_event_t* event) {
+    subtitle_t* sub = (subtitle_t*)data;
+
+    switch (event->type) {
+    case EIA608_EVENT_CUE_START:
+	end_cue(sub, event->frame);
+	memset(sub->rows, 0, sizeof(sub->rows));
+	sub->open = 1;
+	sub->start = event->frame;
+	break;
+
+    case EIA608_EVENT_CUE_END:
+	end_cue(sub, event->frame);
+	break;
+
+    case EIA608_EVENT_ROW:
+	eia608_row_to_utf8(event->cells, sub->rows[event->row]);
+	break;
+    }
+}
+
+void subtitle_finish(subtitle_t* sub, long end) {
+    end_cue(sub, end);
+}
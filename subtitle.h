@@ -0,0 +1,51 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __SUBTITLE_H
+#define __SUBTITLE_H
+
+#include <stdio.h>
+
+#include "eia608.h"
+
+typedef struct __subtitle_struct subtitle_t;
+
+/* output formats */
+#define SUBTITLE_SRT 0
+#define SUBTITLE_VTT 1
+
+/* write cues to out, converting frame numbers to times at
+   rate_num/rate_den frames per second */
+subtitle_t* subtitle_new(FILE* out, int format, int rate_num, int rate_den);
+
+/* finish the file; out is left open */
+void subtitle_free(subtitle_t* sub);
+
+/* write one cue shown from frame start up to (not including) frame end.
+   text is UTF-8, one line per displayed row. */
+void subtitle_write(subtitle_t* sub, long start, long end, const char* text);
+
+/* an eia608_event_fn that turns a decoder's events into cues; give it
+   the subtitle_t as data */
+void subtitle_event(void* data, const eia608_event_t* event);
+
+/* write the cue still on screen, if there is one, as ending at frame end */
+void subtitle_finish(subtitle_t* sub, long end);
+
+#endif /* ndef __SUBTITLE_H */
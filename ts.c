@@ -0,0 +1,471 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Primary references:
+ * ISO/IEC 13818-1, Generic Coding of Moving Pictures and Associated
+ * Audio Information: Systems
+ * ATSC A/53 Part 4, MPEG-2 Video System Characteristics (cc_data)
+ */
+
+/*
+ * Packets are read into one buffer a few hundred at a time and looked at
+ * where they lie; only the video stream's payloads are examined at all,
+ * by a state machine that is fed them byte by byte as they come (and so
+ * doesn't mind cc_data being split between packets) looking for the
+ * "GA94" user data identifier and then the cc_data after it.  pictures
+ * are found in decode order, so the captions of each are held back in a
+ * small buffer and let out in order of presentation time.  a picture's
+ * pairs go into a queue for each field, which gives one pair a frame, so
+ * a picture with more than one (a film frame repeating a field) spills
+ * into the frames after it.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ts.h"
+
+#define TS_PACKET_SIZE 188
+#define TS_SYNC        0x47
+#define TS_BUF_PACKETS 512
+
+#define PID_PAT        0x0000
+#define PID_NONE       0xFFFF
+
+/* the video stream types there might be captions in */
+#define STREAM_MPEG1   0x01
+#define STREAM_MPEG2   0x02
+#define STREAM_H264    0x1B
+#define STREAM_HEVC    0x24
+
+/* presentation times are in 90 kHz ticks: 3003 a frame at 29.97 */
+#define FRAME_TICKS    3003
+#define PTS_MASK       ((1LL << 33) - 1)
+
+/* pictures whose presentation is this far out of decode order, or less,
+   come out in the right order */
+#define REORDER        8
+
+/* the most pairs a picture has for a field; cc_count is five bits */
+#define PICTURE_PAIRS  32
+
+/* the most pairs queued for a field; beyond that, the stream has more
+   than there are frames for and the newest are dropped */
+#define QUEUE_PAIRS    128
+
+static const uint8_t user_identifier[] = {'G', 'A', '9', '4', 0x03};
+
+/* where the cc_data state machine is */
+#define CC_SEARCH      0 /* looking for the user identifier */
+#define CC_FLAGS       1 /* process_cc_data_flag and cc_count */
+#define CC_EM_DATA     2
+#define CC_TRIPLET     3
+
+/* the captions of one picture, each field's pairs in order */
+typedef struct {
+    long long pts;
+    uint8_t pairs[2][PICTURE_PAIRS][2];
+    int npairs[2];
+} picture_t;
+
+/* one field's pairs on their way out */
+typedef struct {
+    uint8_t pairs[QUEUE_PAIRS][2];
+    int head, len;
+} queue_t;
+
+struct __ts_struct {
+    int fd;
+    uint8_t* buf;
+    int pos, len, eof;
+    long long skipped;
+    char error[80];
+
+    int pmt_pid, video_pid;
+    int unescape;        /* H.264 and HEVC put emulation prevention bytes in */
+
+    /* the picture whose PES packet is being read */
+    picture_t cur;
+    long long last_pts;
+    int has_pts;
+
+    /* the cc_data state machine */
+    int state, match, count, nbytes, zeros;
+    uint8_t triplet[3];
+
+    /* pictures waiting to be let out, and the first one's time */
+    picture_t waiting[REORDER + 1];
+    int nwaiting;
+    long long pts0;
+    int started;
+    queue_t queue[2];
+    long next;           /* the frame the queues' next pairs go in */
+};
+
+ts_t* ts_new(int fd) {
+    ts_t* ts = calloc(1, sizeof(ts_t));
+
+    ts->fd = fd;
+    ts->buf = malloc(TS_BUF_PACKETS * TS_PACKET_SIZE);
+    ts->pmt_pid = ts->video_pid = PID_NONE;
+    return ts;
+}
+
+void ts_free(ts_t* ts) {
+    free(ts->buf);
+    free(ts);
+}
+
+const char* ts_error(ts_t* ts) {
+    return ts->error;
+}
+
+long long ts_skipped(ts_t* ts) {
+    return ts->skipped;
+}
+
+/* make sure a whole packet is in the buffer at pos, with the sync byte
+   first.  returns 0, 1 at the end, or -1 on an error. */
+static int next_packet(ts_t* ts) {
+    uint8_t* sync;
+    ssize_t n;
+
+    for (;;) {
+	if (ts->len - ts->pos >= TS_PACKET_SIZE) {
+	    if (ts->buf[ts->pos] == TS_SYNC)
+		return 0;
+	    /* lost track of the packets */
+	    sync = memchr(ts->buf + ts->pos + 1, TS_SYNC, ts->len - ts->pos - 1);
+	    n = sync ? sync - ts->buf : ts->len;
+	    ts->skipped += n - ts->pos;
+	    ts->pos = n;
+	    continue;
+	}
+	if (ts->eof) {
+	    ts->skipped += ts->len - ts->pos;
+	    ts->pos = ts->len;
+	    return 1;
+	}
+
+	/* only the part packet left over gets moved */
+	memmove(ts->buf, ts->buf + ts->pos, ts->len - ts->pos);
+	ts->len -= ts->pos;
+	ts->pos = 0;
+	n = read(ts->fd, ts->buf + ts->len, TS_BUF_PACKETS * TS_PACKET_SIZE - ts->len);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n < 0) {
+	    snprintf(ts->error, sizeof(ts->error), "%s", strerror(errno));
+	    return -1;
+	}
+	if (n == 0)
+	    ts->eof = 1;
+	ts->len += n;
+    }
+}
+
+/* the PAT and PMT: find the first program, and its first video stream */
+static void read_psi(ts_t* ts, int pid, const uint8_t* p, int len) {
+    const uint8_t* end;
+    int i, info, type;
+
+    /* a section starts after the pointer field, and has to fit */
+    if (len < 1 || 1 + p[0] + 12 > len)
+	return;
+    len -= 1 + p[0];
+    p += 1 + p[0];
+    i = 3 + (((p[1] & 0x0F) << 8) | p[2]) - 4; /* leave off the CRC */
+    if (i > len)
+	return;
+    end = p + i;
+
+    if (pid == PID_PAT && p[0] == 0x00) {
+	for (p += 8; p + 4 <= end; p += 4) {
+	    if (((p[0] << 8) | p[1]) != 0) { /* 0 is the network PID */
+		ts->pmt_pid = ((p[2] & 0x1F) << 8) | p[3];
+		return;
+	    }
+	}
+    } else if (pid == ts->pmt_pid && p[0] == 0x02) {
+	info = ((p[10] & 0x0F) << 8) | p[11];
+	for (p += 12 + info; p + 5 <= end; p += 5 + info) {
+	    type = p[0];
+	    info = ((p[3] & 0x0F) << 8) | p[4];
+	    if (type == STREAM_MPEG1 || type == STREAM_MPEG2 ||
+		type == STREAM_H264 || type == STREAM_HEVC) {
+		ts->video_pid = ((p[1] & 0x1F) << 8) | p[2];
+		ts->unescape = (type == STREAM_H264 || type == STREAM_HEVC);
+		return;
+	    }
+	}
+    }
+}
+
+/* done with the picture being read; its captions wait their turn */
+static void end_picture(ts_t* ts) {
+    if (ts->cur.npairs[0] || ts->cur.npairs[1])
+	ts->waiting[ts->nwaiting++] = ts->cur;
+    ts->cur.npairs[0] = ts->cur.npairs[1] = 0;
+}
+
+/* the 33-bit time in a PES header */
+static long long pes_time(const uint8_t* p) {
+    return ((long long)(p[0] & 0x0E) << 29) | (p[1] << 22) | ((p[2] & 0xFE) << 14) |
+	(p[3] << 7) | (p[4] >> 1);
+}
+
+/* the start of a PES packet, which is the start of a picture.  returns
+   the length of the header, to be skipped. */
+static int start_picture(ts_t* ts, const uint8_t* p, int len) {
+    int header;
+
+    end_picture(ts);
+
+    /* guess, if there's no time */
+    ts->cur.pts = (ts->last_pts + FRAME_TICKS) & PTS_MASK;
+    if (len < 9 || p[0] != 0 || p[1] != 0 || p[2] != 1)
+	return 0;
+    header = 9 + p[8];
+    if ((p[7] & 0x80) && len >= 14)
+	ts->cur.pts = pes_time(p + 9);
+    ts->last_pts = ts->cur.pts;
+
+    ts->state = CC_SEARCH;
+    ts->match = 0;
+    return header < len ? header : len;
+}
+
+static void cc_triplet(ts_t* ts, const uint8_t* t) {
+    int field = t[0] & 0x01;
+    int n = ts->cur.npairs[field];
+
+    /* cc_valid, and cc_type 0 or 1 */
+    if (!(t[0] & 0x04) || (t[0] & 0x02) || n == PICTURE_PAIRS)
+	return;
+    ts->cur.pairs[field][n][0] = t[1];
+    ts->cur.pairs[field][n][1] = t[2];
+    ts->cur.npairs[field] = n + 1;
+}
+
+/* run some of the video stream through the cc_data state machine */
+static void video_payload(ts_t* ts, const uint8_t* p, const uint8_t* end) {
+    uint8_t b;
+
+    while (p < end) {
+	if (ts->state == CC_SEARCH && ts->match == 0) {
+	    /* skip straight to the next possible identifier */
+	    p = memchr(p, user_identifier[0], end - p);
+	    if (!p)
+		return;
+	}
+	b = *p++;
+
+	if (ts->state != CC_SEARCH && ts->unescape) {
+	    if (ts->zeros >= 2 && b == 0x03) {
+		ts->zeros = 0;
+		continue;
+	    }
+	    ts->zeros = b == 0 ? ts->zeros + 1 : 0;
+	}
+
+	switch (ts->state) {
+	case CC_SEARCH:
+	    if (b == user_identifier[ts->match]) {
+		if (++ts->match == sizeof(user_identifier)) {
+		    ts->state = CC_FLAGS;
+		    ts->zeros = 0;
+		}
+	    } else {
+		ts->match = (b == user_identifier[0]);
+	    }
+	    break;
+	case CC_FLAGS:
+	    ts->count = b & 0x1F;
+	    ts->state = (b & 0x40) && ts->count ? CC_EM_DATA : CC_SEARCH;
+	    ts->match = 0;
+	    break;
+	case CC_EM_DATA:
+	    ts->state = CC_TRIPLET;
+	    ts->nbytes = 0;
+	    break;
+	case CC_TRIPLET:
+	    ts->triplet[ts->nbytes++] = b;
+	    if (ts->nbytes < 3)
+		break;
+	    cc_triplet(ts, ts->triplet);
+	    ts->nbytes = 0;
+	    if (--ts->count == 0)
+		ts->state = CC_SEARCH;
+	    break;
+	}
+    }
+}
+
+/* look at one packet */
+static void packet(ts_t* ts, const uint8_t* p) {
+    int pid = ((p[1] & 0x1F) << 8) | p[2];
+    int start = p[1] & 0x40;
+    int afc = (p[3] >> 4) & 0x03;
+    const uint8_t* end = p + TS_PACKET_SIZE;
+
+    /* transport errors, and packets with no payload */
+    if ((p[1] & 0x80) || !(afc & 0x01))
+	return;
+    if (pid != ts->video_pid && pid != PID_PAT && pid != ts->pmt_pid)
+	return;
+
+    p += 4;
+    if (afc & 0x02)
+	p += 1 + p[0];
+    if (p >= end)
+	return;
+
+    if (pid == ts->video_pid) {
+	if (start)
+	    p += start_picture(ts, p, end - p);
+	video_payload(ts, p, end);
+    } else if (start && ts->video_pid == PID_NONE) {
+	read_psi(ts, pid, p, end - p);
+    }
+}
+
+/* the earliest waiting picture */
+static picture_t* earliest(ts_t* ts) {
+    picture_t* first = &ts->waiting[0];
+    int i;
+
+    for (i = 1; i < ts->nwaiting; ++i) {
+	if (((ts->waiting[i].pts - first->pts) & PTS_MASK) > PTS_MASK / 2)
+	    first = &ts->waiting[i];
+    }
+    return first;
+}
+
+/* the frame a picture is presented in, counting from the first.  a
+   picture up to a quarter of a frame early still counts as in it, so
+   that the two pictures of a 59.94 fps frame, 1501 or 1502 ticks apart,
+   fall in the same one. */
+static long frame_of(ts_t* ts, long long pts) {
+    long long d = (pts - ts->pts0) & PTS_MASK;
+
+    if (d > PTS_MASK / 2)
+	d -= PTS_MASK + 1;
+    d += FRAME_TICKS / 4;
+    return d >= 0 ? d / FRAME_TICKS : -((-d + FRAME_TICKS - 1) / FRAME_TICKS);
+}
+
+/* queue the pairs of the earliest waiting picture, and let it go */
+static void queue_picture(ts_t* ts) {
+    picture_t* pic = earliest(ts);
+    queue_t* q;
+    int field, i;
+
+    for (field = 0; field < 2; ++field) {
+	q = &ts->queue[field];
+	for (i = 0; i < pic->npairs[field] && q->len < QUEUE_PAIRS; ++i) {
+	    memcpy(q->pairs[(q->head + q->len++) % QUEUE_PAIRS], pic->pairs[field][i], 2);
+	}
+    }
+    *pic = ts->waiting[--ts->nwaiting];
+}
+
+/* put the next pair of each field, or padding, in frame ts->next */
+static void put_frame(ts_t* ts, uint8_t* bytes) {
+    queue_t* q;
+    int field;
+
+    for (field = 0; field < 2; ++field) {
+	q = &ts->queue[field];
+	if (q->len == 0) {
+	    memset(bytes + 2*field, 0x80, 2);
+	    continue;
+	}
+	memcpy(bytes + 2*field, q->pairs[q->head], 2);
+	q->head = (q->head + 1) % QUEUE_PAIRS;
+	q->len--;
+    }
+    ts->next++;
+}
+
+long ts_read(ts_t* ts, uint8_t* bytes, long max, long* first) {
+    long n = 0, frame;
+    int ret;
+
+    while (n < max) {
+	if (ts->nwaiting > REORDER || (ts->eof && ts->nwaiting > 0)) {
+	    if (!ts->started) {
+		ts->pts0 = earliest(ts)->pts;
+		ts->started = 1;
+	    }
+	    frame = frame_of(ts, earliest(ts)->pts);
+
+	    /* pairs spilled from earlier pictures go in the frames up to
+	       this one; after them, a gap ends the run */
+	    if (frame > ts->next && !ts->queue[0].len && !ts->queue[1].len) {
+		if (n > 0)
+		    break;
+		ts->next = frame;
+	    }
+	    if (frame > ts->next) {
+		if (n == 0)
+		    *first = ts->next;
+		put_frame(ts, bytes + 4*n++);
+		continue;
+	    }
+
+	    /* every picture of this frame, in order; a picture too late
+	       for its frame has its pairs put in the next one */
+	    do {
+		queue_picture(ts);
+	    } while (ts->nwaiting > 0 && frame_of(ts, earliest(ts)->pts) <= frame);
+	    if (frame == ts->next) {
+		if (n == 0)
+		    *first = ts->next;
+		put_frame(ts, bytes + 4*n++);
+	    }
+	    continue;
+	}
+	if (ts->eof && ts->nwaiting == 0) {
+	    /* what's still queued goes in the frames after the last */
+	    if (!ts->queue[0].len && !ts->queue[1].len)
+		break;
+	    if (n == 0)
+		*first = ts->next;
+	    put_frame(ts, bytes + 4*n++);
+	    continue;
+	}
+
+	ret = next_packet(ts);
+	if (ret < 0)
+	    return -1;
+	if (ret > 0) {
+	    /* the last picture is over too */
+	    end_picture(ts);
+	    continue;
+	}
+	packet(ts, ts->buf + ts->pos);
+	ts->pos += TS_PACKET_SIZE;
+    }
+
+    return n;
+}
@@ -0,0 +1,53 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __TS_H
+#define __TS_H
+
+#include <inttypes.h>
+
+/*
+ * Line-21 captions carried in an MPEG transport stream as ATSC A/53
+ * cc_data: the user data of each picture of the first video stream of
+ * the first program (MPEG-2, H.264 or HEVC) holds triplets, of which
+ * cc_type 0 is a field 1 pair and cc_type 1 a field 2 pair.
+ */
+
+typedef struct __ts_struct ts_t;
+
+/* read the transport stream from fd, which can be a pipe, and is left
+   open when the demuxer is freed.  memory use is fixed. */
+ts_t* ts_new(int fd);
+void ts_free(ts_t* ts);
+
+/* read up to max consecutive frames of 29.97 fps video into bytes, four
+   bytes a frame as eia608_input takes them, in display order, and set
+   *first to the frame number of the first of them, counting from the
+   first picture with captions.  frames with no caption data end a run;
+   they are padding.  returns the number of frames, 0 at the end of the
+   stream, or -1 on a read error. */
+long ts_read(ts_t* ts, uint8_t* bytes, long max, long* first);
+
+/* what went wrong when ts_read returned -1 */
+const char* ts_error(ts_t* ts);
+
+/* how many bytes have been skipped looking for packets */
+long long ts_skipped(ts_t* ts);
+
+#endif /* ndef __TS_H */
@@ -1,198 +1,1861 @@
 #define _XOPEN_SOURCE_EXTENDED
 #define _LARGEFILE64_SOURCE
 
-#include <assert.h>
 #include <fcntl.h>
 #include <locale.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
 
-#include <quicktime.h>
-#include <libdv/dv.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include <curses.h>
 #include <term.h>
 
+#include "ccindex.h"
+#include "ccscan.h"
+#include "checkpoint.h"
+#include "dif.h"
+#include "dvstream.h"
 #include "eia608.h"
+#include "monitor.h"
+#include "mov.h"
+#include "pool.h"
+#include "ring.h"
+#include "scc.h"
 #include "smpte.h"
+#include "subtitle.h"
+#include "ts.h"
+#include "vbi.h"
 
-#define DV_PAL_SIZE (12 * 150 * 80)
-#define DV_NTSC_SIZE  (10 * 150 * 80)
+/* frames between checkpoints: 10 s of NTSC, 12 s of PAL */
+#define CHECKPOINT_INTERVAL 300
+
+/* -f scc: not cues, but the caption bytes of field 1 as they are */
+#define FORMAT_SCC 2
+/* -x: not cues, but the words of the captions into the caption index */
+#define FORMAT_INDEX 3
+
+#define DV_PAL_SIZE DIF_PAL_SIZE
+#define DV_NTSC_SIZE DIF_NTSC_SIZE
 
 char* cls = NULL;
 
-void display(const char* header, eia608_t* cc) {
-    int i,j;
-    cchar_t wch;
+/* the caption index being added to with -x, if any */
+const char* caption_index_name = NULL;
+ccindex_writer_t* caption_index = NULL;
 
-    move(0,0);
-    printw("%s\n", header);
+/* with -v, the time spent in each stage of the work is measured and,
+   with the decoders' counters, reported on exit.  a stage's time doesn't
+   include that of the stages timed within it, such as the rendering of
+   cues the decoder does as it goes. */
+#define STAGE_READ   0 /* bringing in the VAUX blocks of a frame */
+#define STAGE_PARSE  1 /* finding the caption pack in them */
+#define STAGE_DECODE 2
+#define STAGE_RENDER 3 /* drawing the screen, or writing cues */
+#define NSTAGES      4
 
-    wchar_t** scr = eia608_get_screen(cc);
-    int** att = eia608_get_attributes(cc);
-    for(i = 0; i < EIA608_ROWS; ++i) {
-	for(j = 0; j < EIA608_COLUMNS; ++j) {
-	    wchar_t ch = scr[i][j];
-	    int a = att[i][j];
-	    wch.chars[0] = ch == 0 ? L' ' : ch;
-	    wch.chars[1] = 0;
-	    wch.attr = COLOR_PAIR((a & 0x7) + 1);
-	    if (a & EIA608_UNDERLINE)
-		wch.attr |= A_UNDERLINE;
-	    if (a & EIA608_ITALIC)
-		wch.attr |= A_STANDOUT; /* curses doesn't have italics */
-	    add_wch(&wch);;
-	}
-	printw("\n");
+static const char* stage_names[NSTAGES] = {"read", "dv parse", "decode", "render"};
+
+int timing = 0;
+long stage_calls[NSTAGES], stage_wall[NSTAGES], stage_cpu[NSTAGES];
+eia608_stats_t decoder_totals;
+pthread_mutex_t decoder_totals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* what this thread has charged to all stages so far */
+static __thread long charged_wall, charged_cpu;
+
+typedef struct {
+    long wall, cpu;
+    long charged_wall, charged_cpu;
+} stage_timer_t;
+
+static long clock_ns(clockid_t clock) {
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void stage_start(stage_timer_t* t) {
+    t->wall = clock_ns(CLOCK_MONOTONIC);
+    t->cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    t->charged_wall = charged_wall;
+    t->charged_cpu = charged_cpu;
+}
+
+/* charge the time since stage_start to a stage, and start timing again */
+static void stage_end(int stage, stage_timer_t* t) {
+    long wall = clock_ns(CLOCK_MONOTONIC);
+    long cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    long dwall = wall - t->wall - (charged_wall - t->charged_wall);
+    long dcpu = cpu - t->cpu - (charged_cpu - t->charged_cpu);
+
+    __sync_fetch_and_add(&stage_calls[stage], 1);
+    __sync_fetch_and_add(&stage_wall[stage], dwall);
+    __sync_fetch_and_add(&stage_cpu[stage], dcpu);
+    charged_wall += dwall;
+    charged_cpu += dcpu;
+
+    t->wall = wall;
+    t->cpu = cpu;
+    t->charged_wall = charged_wall;
+    t->charged_cpu = charged_cpu;
+}
+
+static void add_stats(const eia608_stats_t* stats) {
+    int i;
+
+    pthread_mutex_lock(&decoder_totals_lock);
+    decoder_totals.pairs += stats->pairs;
+    decoder_totals.parity_errors += stats->parity_errors;
+    decoder_totals.duplicates += stats->duplicates;
+    for (i = 0; i < 16; ++i) {
+	decoder_totals.commands[i] += stats->commands[i];
     }
+    decoder_totals.pacs += stats->pacs;
+    decoder_totals.chars_front += stats->chars_front;
+    decoder_totals.chars_back += stats->chars_back;
+    decoder_totals.swaps += stats->swaps;
+    pthread_mutex_unlock(&decoder_totals_lock);
+}
+
+/* add a decoder's counters to the totals, then free it */
+void finish_decoder(eia608_t* decoder) {
+    eia608_stats_t stats;
 
-    refresh();
+    if (timing) {
+	eia608_get_stats(decoder, &stats);
+	add_stats(&stats);
+    }
+    eia608_free(decoder);
 }
 
-int main(int argc, char** argv) {
-    quicktime_t* qtfile;
-    char* codec;
+void finish_multi(eia608_multi_t* multi) {
+    eia608_stats_t stats;
+
+    if (timing) {
+	eia608_multi_get_stats(multi, &stats);
+	add_stats(&stats);
+    }
+    eia608_multi_free(multi);
+}
+
+void print_timing(long wall, long cpu) {
+    static const char* commands[16] = {
+	"RCL", "BS", "AOF", "AON", "DER", "RU2", "RU3", "RU4",
+	"FON", "RDC", "TR", "RTD", "EDM", "CR", "ENM", "EOC"
+    };
+    eia608_stats_t* s = &decoder_totals;
+    int i;
+
+    fprintf(stderr, "%-10s %10s %10s %10s %10s\n", "stage", "calls", "wall s", "cpu s", "ns/call");
+    for (i = 0; i < NSTAGES; ++i) {
+	fprintf(stderr, "%-10s %10ld %10.3f %10.3f %10.0f\n", stage_names[i], stage_calls[i],
+		stage_wall[i] * 1e-9, stage_cpu[i] * 1e-9,
+		stage_calls[i] ? (double)stage_wall[i] / stage_calls[i] : 0.0);
+    }
+    fprintf(stderr, "%-10s %10s %10.3f %10.3f\n", "total", "", wall * 1e-9, cpu * 1e-9);
+    fprintf(stderr, "(stage times are summed over all threads)\n");
+
+    fprintf(stderr, "\npairs %lu, parity errors %lu, duplicates %lu, PACs %lu, swaps %lu\n",
+	    s->pairs, s->parity_errors, s->duplicates, s->pacs, s->swaps);
+    fprintf(stderr, "characters to the screen %lu, to the back %lu\n",
+	    s->chars_front, s->chars_back);
+    for (i = 0; i < 16; ++i) {
+	fprintf(stderr, "%s %lu%s", commands[i], s->commands[i], i % 8 == 7 ? "\n" : ", ");
+    }
+}
+
+/* eia608_input, timed if need be */
+void decode_frame(eia608_t* decoder, const uint8_t* cc) {
+    stage_timer_t t;
+
+    if (!timing) {
+	eia608_input(decoder, cc);
+	return;
+    }
+    stage_start(&t);
+    eia608_input(decoder, cc);
+    stage_end(STAGE_DECODE, &t);
+}
+
+void start_curses(void) {
+    initscr();
+    cbreak();
+    noecho();
+    nodelay(stdscr, TRUE);
+    keypad(stdscr, TRUE);
+    init_pair(1, COLOR_WHITE, COLOR_BLACK);
+    init_pair(2, COLOR_GREEN, COLOR_BLACK);
+    init_pair(3, COLOR_BLUE, COLOR_BLACK);
+    init_pair(4, COLOR_CYAN, COLOR_BLACK);
+    init_pair(5, COLOR_RED, COLOR_BLACK);
+    init_pair(6, COLOR_YELLOW, COLOR_BLACK);
+    init_pair(7, COLOR_MAGENTA, COLOR_BLACK);
+}
+
+void usage(const char* prog) {
+    fprintf(stderr,
+	    "usage: %s [-v] [-s service] [-c index] [-t start] [-j threads] file\n"
+	    "       %s [-v] [-s service] -f srt|vtt|scc [-o outfile] [-c index] [-j threads] [-g WxH] file\n"
+	    "       %s [-v] [-s service] -f srt|vtt|scc [-j threads] [-l list] [-g WxH] [file...]\n"
+	    "       %s [-v] -m [-r rate] [-s service]... [-l list] [file...]\n"
+	    "       %s [-v] [-s service] -x index [-j threads] [-l list] [-g WxH] [file...]\n"
+	    "  -s  caption service: cc1-cc4 or text1-text4 (default cc1)\n"
+	    "  -f  write cues in the given format as fast as possible\n"
+	    "      instead of showing captions in real time; scc copies\n"
+	    "      field 1 as it is, and an SCC file can be read in place\n"
+	    "      of video, as can a transport stream, or uncompressed\n"
+	    "      video (Y4M, .uyvy or .v210) with line 21 in the picture\n"
+	    "  -o  where to write cues (default stdout)\n"
+	    "  -c  checkpoint index to seek with; made while writing cues,\n"
+	    "      or when first seeking if the file doesn't have one\n"
+	    "  -t  timecode (HH:MM:SS:FF) or frame to start showing\n"
+	    "      captions at\n"
+	    "  -j  threads to look for captions in a file with, or with\n"
+	    "      several files, files to work on at once (default 1)\n"
+	    "  -l  also extract every file named in list, one per line\n"
+	    "      (- for stdin); with more than one file, the cues for\n"
+	    "      each go next to it, with an .srt or .vtt extension\n"
+	    "  a file can also be - (stdin) or a pipe carrying raw DV,\n"
+	    "  which is decoded as it comes in, and can't be seeked\n"
+	    "  -m  monitor several files and services at once, a pane\n"
+	    "      each, all playing in real time; -s can be repeated\n"
+	    "  -r  most times a second to update the monitor (default 10)\n"
+	    "  -g  size of raw UYVY or v210 frames (default 720x486)\n"
+	    "  -x  add the words of the captions to a caption index to\n"
+	    "      search with ccfind, made if it doesn't exist yet\n"
+	    "  -v  when done, say how long reading, parsing, decoding and\n"
+	    "      rendering took, and what the decoder did\n",
+	    prog, prog, prog, prog, prog);
+}
+
+/* what goes in place of a frame with no caption pack */
+static const uint8_t padding[4] = {0x80, 0x80, 0x80, 0x80};
+
+typedef struct {
+    const char* name;
+    mov_t* mov;
+    int fd;
+    unsigned char* map;
+    off64_t mapsize;
     int framesize;
-    unsigned char* buffer;
-    dv_decoder_t* dv;
-    uint8_t cc[4];
-    long i, nframes;
-    eia608_t* decoder;
-    smpte_t* tc;
-    char tcbuf[SMPTE_STR_LEN];
-    int uselibqt;
-    int fd = 0;
+    long nframes;
+} input_t;
 
-    struct timeval tv, now;
-    struct timespec delay;
+/* open a QuickTime or raw DV file.  returns 0, or prints why not and
+   returns -1. */
+int open_input(const char* name, input_t* in) {
+    const char* error;
+    long i;
 
-    setlocale(LC_ALL, "");
+    memset(in, 0, sizeof(input_t));
 
-    if (argc != 2) {
-	fprintf(stderr, "please provide one arg, the name of the file you want.\n");
-	return 1;
+    in->name = name;
+    in->fd = open(name, O_RDONLY);
+    if (in->fd < 0) {
+	perror(name);
+	return -1;
     }
 
-    qtfile = quicktime_open(argv[1], 1, 0);
+    /* either way the file is read in place; only the VAUX blocks of each
+       frame get touched */
+    in->mapsize = lseek64(in->fd, 0, SEEK_END);
+    if (in->mapsize >= DIF_BLOCK_SIZE)
+	in->map = mmap(NULL, in->mapsize, PROT_READ, MAP_SHARED, in->fd, 0);
+    if (in->map == MAP_FAILED)
+	in->map = NULL;
+    if (!in->map) {
+	fprintf(stderr, "%s: couldn't map file\n", name);
+	close(in->fd);
+	return -1;
+    }
 
-    if (qtfile) {
-	uselibqt = 1;
-	if (quicktime_video_tracks(qtfile) != 1) {
-	    fprintf(stderr, "expected file with exactly 1 video track.\n");
-	    return 1;
+    in->mov = mov_open(in->fd, &error);
+    if (in->mov) {
+	in->nframes = mov_frames(in->mov);
+	if (in->nframes > 0)
+	    in->framesize = mov_frame_size(in->mov, 0);
+	if (in->framesize != DV_PAL_SIZE && in->framesize != DV_NTSC_SIZE)
+	    error = "couldn't get frame size";
+
+	/* every frame has to be a whole DV frame inside the file */
+	for (i = 0; !error && i < in->nframes; ++i) {
+	    uint64_t off = mov_frame_offset(in->mov, i);
+
+	    if (mov_frame_size(in->mov, i) != (uint32_t)in->framesize ||
+		off > (uint64_t)in->mapsize ||
+		(uint64_t)in->mapsize - off < (uint64_t)in->framesize)
+		error = "frame table points outside the file";
 	}
+	if (error)
+	    mov_free(in->mov);
+    } else if (!error) {
+	in->framesize = dif_frame_size(in->map);
+	if (in->framesize == 0)
+	    error = "file does not appear to be either quicktime or raw DV";
+	else
+	    in->nframes = in->mapsize / in->framesize;
+    }
 
-	codec = quicktime_video_compressor(qtfile, 0);
-	if (strcmp(codec, QUICKTIME_DV) &&
-	    strcmp(codec, QUICKTIME_DV_AVID) &&
-	    strcmp(codec, QUICKTIME_DV_AVID_A)) {
-	    fprintf(stderr, "expected DV video codec, got %s.\n", codec);
-	    return 1;
+    if (error) {
+	fprintf(stderr, "%s: %s\n", name, error);
+	munmap(in->map, in->mapsize);
+	close(in->fd);
+	return -1;
+    }
+
+    madvise(in->map, in->mapsize, MADV_SEQUENTIAL);
+    return 0;
+}
+
+void close_input(input_t* in) {
+    if (in->mov)
+	mov_free(in->mov);
+    munmap(in->map, in->mapsize);
+    close(in->fd);
+}
+
+/* whether name is to be read as a stream, not mapped: - for stdin, or
+   anything other than a plain file */
+int is_stream(const char* name) {
+    struct stat st;
+
+    if (strcmp(name, "-") == 0)
+	return 1;
+    return stat(name, &st) == 0 && !S_ISREG(st.st_mode);
+}
+
+/* open a stream.  returns its descriptor, or prints why not and returns
+   -1. */
+int open_stream(const char* name) {
+    int fd = strcmp(name, "-") == 0 ? 0 : open(name, O_RDONLY);
+
+    if (fd < 0)
+	perror(name);
+    return fd;
+}
+
+void close_stream(const char* name, int fd, dvstream_t* stream) {
+    if (dvstream_skipped(stream) > 0)
+	fprintf(stderr, "%s: skipped %lld bytes that weren't DV\n",
+		name, dvstream_skipped(stream));
+    dvstream_free(stream);
+    if (fd != 0)
+	close(fd);
+}
+
+/* read the next frame of a stream and find its caption pack, or padding
+   if it has none.  returns the size of the frame, 0 at the end, or -1 on
+   an error. */
+int stream_cc(const char* name, dvstream_t* stream, uint8_t* cc) {
+    const uint8_t* frame;
+    stage_timer_t t;
+    int size;
+
+    if (timing)
+	stage_start(&t);
+    size = dvstream_read(stream, &frame);
+    if (timing)
+	stage_end(STAGE_READ, &t);
+
+    if (size < 0)
+	perror(name);
+    if (size <= 0)
+	return size;
+
+    if (dif_get_vaux_pack(frame, size, DIF_PACK_CC, cc) != 0)
+	memcpy(cc, padding, 4);
+    if (timing)
+	stage_end(STAGE_PARSE, &t);
+    return size;
+}
+
+/* frame i of the input, straight out of the mapping */
+const unsigned char* get_frame(input_t* in, long i) {
+    if (in->mov)
+	return in->map + mov_frame_offset(in->mov, i);
+    return in->map + (off64_t)i * in->framesize;
+}
+
+/* bring the VAUX blocks of frame i in from the file, if they aren't in
+   memory already */
+void read_frame(input_t* in, long i) {
+    const unsigned char* frame = get_frame(in, i);
+    volatile unsigned char sink;
+    int seq;
+
+    for (seq = 0; seq < in->framesize / DIF_SEQUENCE_SIZE; ++seq) {
+	sink = frame[seq*DIF_SEQUENCE_SIZE + DIF_VAUX_OFFSET];
+	sink = frame[seq*DIF_SEQUENCE_SIZE + DIF_VAUX_OFFSET + DIF_VAUX_SIZE - 1];
+    }
+    (void)sink;
+}
+
+/* find the caption pack of frame i */
+int parse_frame(input_t* in, long i, uint8_t* cc) {
+    return dif_get_vaux_pack(get_frame(in, i), in->framesize, DIF_PACK_CC, cc);
+}
+
+/* a ccscan_extract_fn */
+int extract_cc(void* source, long i, uint8_t* cc) {
+    input_t* in = (input_t*)source;
+    stage_timer_t t;
+    int ret;
+
+    if (!timing)
+	return parse_frame(in, i, cc);
+
+    /* reading the blocks in from the file counts as reading, not parsing */
+    stage_start(&t);
+    read_frame(in, i);
+    stage_end(STAGE_READ, &t);
+
+    ret = parse_frame(in, i, cc);
+    stage_end(STAGE_PARSE, &t);
+
+    return ret;
+}
+
+/* subtitle_event, timed as rendering */
+void timed_subtitle_event(void* data, const eia608_event_t* event) {
+    stage_timer_t t;
+
+    stage_start(&t);
+    subtitle_event(data, event);
+    stage_end(STAGE_RENDER, &t);
+}
+
+/* ccindex_event, timed as rendering */
+void timed_index_event(void* data, const eia608_event_t* event) {
+    stage_timer_t t;
+
+    stage_start(&t);
+    ccindex_event(data, event);
+    stage_end(STAGE_RENDER, &t);
+}
+
+/* what a decoder's captions are made into: cues, a copy of their bytes
+   as SCC, or words for the caption index */
+typedef struct {
+    subtitle_t* sub;
+    scc_writer_t* scc;
+    ccindex_doc_t* doc;
+} output_t;
+
+/* start making one service of the captions of name, at num/den frames a
+   second, into format, written to out */
+void start_output(output_t* output, eia608_t* decoder, const char* name, FILE* out,
+		  int service, int format, int num, int den) {
+    memset(output, 0, sizeof(output_t));
+    if (format == FORMAT_SCC) {
+	output->scc = scc_writer_new(out);
+    } else if (format == FORMAT_INDEX) {
+	output->doc = ccindex_doc_new(name, service, num, den);
+	eia608_set_event_handler(decoder, timing ? timed_index_event : ccindex_event, output->doc);
+    } else {
+	output->sub = subtitle_new(out, format, num, den);
+	eia608_set_event_handler(decoder, timing ? timed_subtitle_event : subtitle_event, output->sub);
+    }
+}
+
+/* finish the output, the last cue ending at frame end.  the words only go
+   into the index if the whole file was decoded.  returns 0, or -1 if the
+   index couldn't be written to. */
+int finish_output(output_t* output, long end, int whole) {
+    int ret = 0;
+
+    if (output->sub) {
+	subtitle_finish(output->sub, end);
+	subtitle_free(output->sub);
+    }
+    if (output->scc)
+	scc_writer_free(output->scc);
+    if (output->doc && !whole) {
+	ccindex_doc_free(output->doc);
+    } else if (output->doc && ccindex_writer_add(caption_index, output->doc) != 0) {
+	perror(caption_index_name);
+	ret = -1;
+    }
+    memset(output, 0, sizeof(output_t));
+    return ret;
+}
+
+/* where decode_cc sends frames: a decoder, an index to add a checkpoint
+   to every so often, if any, and an SCC file to copy them to, if any */
+typedef struct {
+    eia608_t* decoder;
+    checkpoint_t* index;
+    scc_writer_t* scc;
+} scan_t;
+
+/* copy n frames to an SCC file, timed as rendering */
+void write_scc(scc_writer_t* scc, long first, long n, const uint8_t* bytes) {
+    stage_timer_t t;
+    long i;
+
+    if (timing)
+	stage_start(&t);
+    for (i = 0; i < n; ++i) {
+	scc_write(scc, first + i, bytes + 4*i);
+    }
+    if (timing)
+	stage_end(STAGE_RENDER, &t);
+}
+
+/* a ccscan_sink_fn */
+void decode_cc(void* data, long first, long n, const uint8_t* bytes) {
+    scan_t* scan = (scan_t*)data;
+    long interval, len;
+    stage_timer_t t;
+
+    if (timing)
+	stage_start(&t);
+
+    if (scan->scc)
+	write_scc(scan->scc, first, n, bytes);
+
+    eia608_set_frame(scan->decoder, first);
+
+    /* stop at each multiple of the interval to save the state */
+    interval = scan->index ? checkpoint_interval(scan->index) : 0;
+    while (n > 0) {
+	len = n;
+	if (interval) {
+	    if (first % interval == 0)
+		checkpoint_add(scan->index, scan->decoder);
+	    len = interval - first % interval;
 	}
+	if (len > n)
+	    len = n;
+	eia608_input_batch(scan->decoder, bytes, len);
+	bytes += 4*len;
+	first += len;
+	n -= len;
+    }
 
-	framesize = quicktime_frame_size(qtfile, 0, 0);
-	if (framesize == 0) {
-	    fprintf(stderr, "couldn't get frame size.\n");
-	    return 1;
+    if (timing)
+	stage_end(STAGE_DECODE, &t);
+}
+
+/* decode one service of a whole input as fast as possible and write its
+   cues to out, adding checkpoints to index along the way if it isn't
+   NULL.  returns 0, or -1 on failure. */
+int write_cues(input_t* in, FILE* out, int service, int format, int nthreads,
+	       checkpoint_t* index) {
+    int ntsc = (in->framesize == DV_NTSC_SIZE);
+    output_t output;
+    scan_t scan;
+    int ret;
+
+    if (format == FORMAT_SCC && !ntsc) {
+	fprintf(stderr, "SCC is only for NTSC.\n");
+	return -1;
+    }
+
+    scan.decoder = eia608_new();
+    scan.index = index;
+    eia608_set_wanted(scan.decoder, service);
+    start_output(&output, scan.decoder, in->name, out, service, format,
+		 ntsc ? 30000 : 25, ntsc ? 1001 : 1);
+    scan.scc = output.scc;
+
+    ret = ccscan_run(extract_cc, in, in->nframes, nthreads,
+		     decode_cc, &scan);
+    if (ret != 0)
+	fprintf(stderr, "couldn't start scanning threads.\n");
+
+    if (finish_output(&output, in->nframes, ret == 0) != 0)
+	ret = -1;
+    finish_decoder(scan.decoder);
+
+    return ret;
+}
+
+/* decode one service of a stream as it comes in and write its cues to
+   out.  cues are timed at the frame rate the stream starts with.
+   returns 0, or -1 on failure. */
+int stream_cues(const char* name, FILE* out, int service, int format) {
+    int fd = open_stream(name);
+    dvstream_t* stream;
+    eia608_t* decoder;
+    output_t output;
+    uint8_t cc[4];
+    int size, first = 0, warned = 0;
+
+    if (fd < 0)
+	return -1;
+    stream = dvstream_new(fd);
+    decoder = eia608_new();
+    eia608_set_wanted(decoder, service);
+    memset(&output, 0, sizeof(output_t));
+
+    while ((size = stream_cc(name, stream, cc)) > 0) {
+	if (!first) {
+	    first = size;
+	    if (format == FORMAT_SCC && size != DV_NTSC_SIZE) {
+		fprintf(stderr, "SCC is only for NTSC.\n");
+		size = -1;
+		break;
+	    }
+	    start_output(&output, decoder, name, out, service, format,
+			 size == DV_NTSC_SIZE ? 30000 : 25, size == DV_NTSC_SIZE ? 1001 : 1);
+	} else if (size != first && !warned) {
+	    fprintf(stderr, "%s: frame rate changed at frame %ld; "
+		    "cues are still timed at the first rate\n",
+		    name, eia608_get_frame(decoder));
+	    warned = 1;
 	}
-	nframes = quicktime_video_length(qtfile, 0);
-    } else {
-	off64_t off;
+	if (output.scc)
+	    write_scc(output.scc, eia608_get_frame(decoder), 1, cc);
+	decode_frame(decoder, cc);
+    }
 
-	uselibqt = 0;
-	fd = open(argv[1], O_RDONLY);
-	if (!fd) {
-	    perror("open");
-	    return 1;
+    if (!first)
+	fprintf(stderr, "%s: no DV frames\n", name);
+    if (finish_output(&output, eia608_get_frame(decoder), size == 0) != 0)
+	size = -1;
+    finish_decoder(decoder);
+    close_stream(name, fd, stream);
+
+    return first && size == 0 ? 0 : -1;
+}
+
+/* whether name is an SCC file rather than video */
+int is_scc(const char* name) {
+    char head[16];
+    FILE* f = fopen(name, "r");
+    size_t len;
+
+    if (!f)
+	return 0;
+    len = fread(head, 1, sizeof(head), f);
+    fclose(f);
+
+    if (len >= 3 && memcmp(head, "\xEF\xBB\xBF", 3) == 0)
+	return len >= 16 && memcmp(head + 3, "Scenarist_SCC", 13) == 0;
+    return len >= 13 && memcmp(head, "Scenarist_SCC", 13) == 0;
+}
+
+/* whether name is an MPEG transport stream: packets of 188 bytes, each
+   starting with a sync byte */
+int is_ts(const char* name) {
+    unsigned char head[3 * 188 + 1];
+    FILE* f = fopen(name, "rb");
+    size_t len;
+
+    if (!f)
+	return 0;
+    len = fread(head, 1, sizeof(head), f);
+    fclose(f);
+
+    return len == sizeof(head) && head[0] == 0x47 && head[188] == 0x47 &&
+	head[2 * 188] == 0x47 && head[3 * 188] == 0x47;
+}
+
+/* the size of raw UYVY and v210 frames, which don't say (-g) */
+int raw_width = 720, raw_height = 486;
+
+/* which sort of uncompressed video name is, if any: Y4M says so in its
+   header, but raw UYVY and v210 only in their extension.  returns one of
+   the VBI_ formats, or -1. */
+int vbi_format(const char* name) {
+    char head[10];
+    const char* ext = strrchr(name, '.');
+    FILE* f = fopen(name, "rb");
+    size_t len = 0;
+
+    if (f) {
+	len = fread(head, 1, sizeof(head), f);
+	fclose(f);
+    }
+
+    if (len == sizeof(head) && memcmp(head, "YUV4MPEG2 ", 10) == 0)
+	return VBI_Y4M;
+    if (ext && (strcasecmp(ext, ".uyvy") == 0 || strcasecmp(ext, ".2vuy") == 0))
+	return VBI_UYVY;
+    if (ext && strcasecmp(ext, ".v210") == 0)
+	return VBI_V210;
+    return -1;
+}
+
+/* what sort of file an input is */
+#define INPUT_DV  0 /* raw DV, or DV in QuickTime */
+#define INPUT_SCC 1
+#define INPUT_TS  2
+#define INPUT_VBI 3 /* uncompressed video with line 21 in the picture */
+
+int input_kind(const char* name) {
+    if (is_scc(name))
+	return INPUT_SCC;
+    if (is_ts(name))
+	return INPUT_TS;
+    if (vbi_format(name) >= 0)
+	return INPUT_VBI;
+    return INPUT_DV;
+}
+
+/* a source of caption bytes with no video around them -- an SCC file or
+   a transport stream -- read in runs of consecutive frames, as scc_read
+   and ts_read do */
+typedef long (*run_fn)(void* source, uint8_t* bytes, long max, long* first);
+
+long read_scc(void* source, uint8_t* bytes, long max, long* first) {
+    return scc_read((scc_reader_t*)source, bytes, max, first);
+}
+
+long read_ts(void* source, uint8_t* bytes, long max, long* first) {
+    return ts_read((ts_t*)source, bytes, max, first);
+}
+
+long read_vbi(void* source, uint8_t* bytes, long max, long* first) {
+    return vbi_read((vbi_t*)source, bytes, max, first);
+}
+
+#define RUN_CHUNK 1024
+
+/* decode one service of the runs of frames from read, out of the file
+   name, and write its cues to out, or copy them to out as SCC.  the
+   frames are 29.97 fps.  returns 0, -1 if read fails, or -2 if the
+   index couldn't be written to. */
+int write_runs(const char* name, run_fn read, void* source, FILE* out, int service,
+	       int format) {
+    uint8_t bytes[RUN_CHUNK * 4];
+    output_t output;
+    eia608_t* decoder;
+    stage_timer_t t;
+    long n, first;
+    int ret;
+
+    decoder = eia608_new();
+    eia608_set_wanted(decoder, service);
+    start_output(&output, decoder, name, out, service, format, 30000, 1001);
+
+    for (;;) {
+	if (timing)
+	    stage_start(&t);
+	n = read(source, bytes, RUN_CHUNK, &first);
+	if (timing)
+	    stage_end(STAGE_PARSE, &t);
+	if (n <= 0)
+	    break;
+
+	if (output.scc) {
+	    write_scc(output.scc, first, n, bytes);
+	    continue;
 	}
+	if (timing)
+	    stage_start(&t);
+	/* the frames in between were padding */
+	eia608_set_frame(decoder, first);
+	eia608_input_batch(decoder, bytes, n);
+	if (timing)
+	    stage_end(STAGE_DECODE, &t);
+    }
 
-	buffer = malloc(4);
-	read(fd, buffer, 4);
+    ret = finish_output(&output, eia608_get_frame(decoder), n == 0);
+    finish_decoder(decoder);
 
-	if (!(((buffer[0] & 0xf0) == 0x10) && ((buffer[1] & 0xf0) == 0x00) && (buffer[2] == 0x00))) {
-	    close(fd);
-	    fprintf(stderr, "file does not appear to be either quicktime or raw DV\n");
-	    return 1;
+    return n < 0 ? -1 : ret != 0 ? -2 : 0;
+}
+
+/* write the cues of one service of an SCC file to out, or copy it to out
+   as SCC again.  returns 0, or -1 on failure. */
+int scc_cues(const char* name, FILE* out, int service, int format) {
+    FILE* in;
+    scc_reader_t* reader;
+    int ret;
+
+    if (service & 0x02) {
+	fprintf(stderr, "%s: SCC only has field 1 (cc1, cc2, text1 and text2)\n", name);
+	return -1;
+    }
+    in = fopen(name, "r");
+    if (!in) {
+	perror(name);
+	return -1;
+    }
+
+    reader = scc_reader_new(in);
+    ret = write_runs(name, read_scc, reader, out, service, format);
+    if (ret == -1)
+	fprintf(stderr, "%s: %s\n", name, scc_reader_error(reader));
+    scc_reader_free(reader);
+    fclose(in);
+
+    return ret != 0 ? -1 : 0;
+}
+
+/* write the cues of one service of a transport stream's A/53 captions to
+   out, or copy its field 1 to out as SCC.  returns 0, or -1 on failure. */
+int ts_cues(const char* name, FILE* out, int service, int format) {
+    int fd = open_stream(name);
+    ts_t* ts;
+    int ret;
+
+    if (fd < 0)
+	return -1;
+
+    ts = ts_new(fd);
+    ret = write_runs(name, read_ts, ts, out, service, format);
+    if (ret == -1)
+	fprintf(stderr, "%s: %s\n", name, ts_error(ts));
+    if (ts_skipped(ts) > 0)
+	fprintf(stderr, "%s: skipped %lld bytes that weren't in packets\n",
+		name, ts_skipped(ts));
+    ts_free(ts);
+    if (fd != 0)
+	close(fd);
+
+    return ret != 0 ? -1 : 0;
+}
+
+/* write the cues of one service of the line 21 captions in uncompressed
+   video to out, or copy its field 1 to out as SCC.  returns 0, or -1 on
+   failure. */
+int vbi_cues(const char* name, FILE* out, int service, int format) {
+    int fd = open_stream(name);
+    int row1, row2;
+    vbi_t* vbi;
+    int ret;
+
+    if (fd < 0)
+	return -1;
+
+    vbi = vbi_new(fd, vbi_format(name), raw_width, raw_height);
+    ret = write_runs(name, read_vbi, vbi, out, service, format);
+    if (ret == -1)
+	fprintf(stderr, "%s: %s\n", name, vbi_error(vbi));
+    vbi_rows(vbi, &row1, &row2);
+    if (ret == 0 && row1 < 0)
+	fprintf(stderr, "%s: no line 21 near the top of the picture\n", name);
+    vbi_free(vbi);
+    if (fd != 0)
+	close(fd);
+
+    return ret != 0 ? -1 : 0;
+}
+
+/* write the cues of an input that isn't DV, whatever kind it is */
+int caption_cues(int kind, const char* name, FILE* out, int service, int format) {
+    switch (kind) {
+    case INPUT_SCC:
+	return scc_cues(name, out, service, format);
+    case INPUT_TS:
+	return ts_cues(name, out, service, format);
+    default:
+	return vbi_cues(name, out, service, format);
+    }
+}
+
+/* scan a whole input for one service just to make a checkpoint index */
+checkpoint_t* build_index(input_t* in, int service, int nthreads) {
+    scan_t scan;
+
+    scan.decoder = eia608_new();
+    scan.index = checkpoint_new(CHECKPOINT_INTERVAL);
+    scan.scc = NULL;
+    eia608_set_wanted(scan.decoder, service);
+
+    if (ccscan_run(extract_cc, in, in->nframes, nthreads, decode_cc, &scan) != 0) {
+	fprintf(stderr, "couldn't start scanning threads.\n");
+	checkpoint_free(scan.index);
+	scan.index = NULL;
+    }
+
+    finish_decoder(scan.decoder);
+    return scan.index;
+}
+
+/* write an index to the file name.  returns 0, or prints why not and
+   returns -1. */
+int save_index(const char* name, checkpoint_t* index) {
+    FILE* f = fopen(name, "wb");
+    int ret;
+
+    if (!f) {
+	perror(name);
+	return -1;
+    }
+    ret = checkpoint_write(index, f);
+    if (fclose(f) != 0)
+	ret = -1;
+    if (ret != 0)
+	perror(name);
+    return ret;
+}
+
+/* read the index in name if it is one for this service, or else build it
+   and, if name isn't NULL, save it there for next time */
+checkpoint_t* load_index(const char* name, input_t* in, int service, int nthreads) {
+    checkpoint_t* index = NULL;
+    eia608_t* decoder;
+    FILE* f;
+
+    f = name ? fopen(name, "rb") : NULL;
+    if (f) {
+	index = checkpoint_read(f);
+	fclose(f);
+	/* an index for another service would change the one being shown */
+	decoder = eia608_new();
+	if (index && (checkpoint_seek(index, decoder, 0) != 0 ||
+		      eia608_get_wanted(decoder) != service)) {
+	    checkpoint_free(index);
+	    index = NULL;
 	}
+	eia608_free(decoder);
+    }
+    if (index)
+	return index;
+
+    index = build_index(in, service, nthreads);
+    if (index && name)
+	save_index(name, index);
+    return index;
+}
+
+/* bring decoder to the start of frame target by way of the nearest
+   checkpoint.  returns 0, or -1 if there's no checkpoint to start from. */
+int seek(input_t* in, checkpoint_t* index, eia608_t* decoder, long target) {
+    uint8_t cc[4];
+    long i;
 
-	framesize = DV_NTSC_SIZE;
-	free(buffer);
-	off = lseek64(fd, 0, SEEK_END); /* go to end of file */
-	nframes = off / framesize;
-	lseek(fd, 0, SEEK_SET); /* back to beginning */
+    i = checkpoint_seek(index, decoder, target);
+    if (i < 0)
+	return -1;
+
+    for (; i < target; ++i) {
+	if (extract_cc(in, i, cc) != 0)
+	    memcpy(cc, padding, 4);
+	decode_frame(decoder, cc);
     }
-    printf("%i\n", framesize);
-    assert(framesize == DV_PAL_SIZE || framesize == DV_NTSC_SIZE);
-    buffer = malloc(framesize);
+    return 0;
+}
 
-    if (!buffer) {
-	perror("couldn't malloc");
-	return 1;
+/* bring decoder to the start of frame target by decoding every frame up
+   to it, or if target is behind it, by just carrying on from there */
+void seek_forward(input_t* in, eia608_t* decoder, long target) {
+    uint8_t cc[4];
+    long i = eia608_get_frame(decoder);
+
+    if (target < i) {
+	eia608_set_frame(decoder, target);
+	return;
+    }
+    for (; i < target; ++i) {
+	if (extract_cc(in, i, cc) != 0)
+	    memcpy(cc, padding, 4);
+	decode_frame(decoder, cc);
     }
+}
+
+/* set up the timecode an input counts its frames in */
+void input_timecode(input_t* in, smpte_t* tc) {
+    if (in->framesize == DV_NTSC_SIZE)
+	smpte_init(tc, 1, 30);
+    else
+	smpte_init(tc, 0, 25);
+}
 
-    dv = dv_decoder_new(0, 0, 0);
-    if(!dv) {
-	fprintf(stderr, "couldn't create DV decoder\n");
+/* the frame named by a -t argument, either a timecode or a frame number;
+   -1 if it's neither */
+long parse_start(input_t* in, const char* arg) {
+    smpte_t tc;
+    char* end;
+    long frame;
+
+    input_timecode(in, &tc);
+    if (smpte_parse(&tc, arg) == 0)
+	return smpte_get_frame(&tc);
+
+    frame = strtol(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || frame < 0)
+	return -1;
+    return frame;
+}
+
+/*
+ * The real-time view is a pipeline of four threads, each handing its
+ * work to the next through a ring:
+ *
+ *   reader -> frames -> extractor -> packs -> decoder -> screens -> renderer
+ *
+ * the reader brings the VAUX blocks of each frame in from the file, the
+ * extractor finds the caption pack in them, and the decoder decodes the
+ * packs and sends a copy of the screen whenever it changes.  the first
+ * three run ahead of time as far as the rings let them; only the renderer
+ * (the main thread, which owns curses) keeps time, showing each screen
+ * when its frame comes round, so that the file being slow now and then
+ * doesn't make the captions late.
+ *
+ * seeking starts a new generation: the reader starts again from the new
+ * frame, and everything from an older generation still in the rings is
+ * dropped on its way through.
+ */
+
+#define RING_FRAMES  64
+#define RING_SCREENS 16
+
+/* stamped on everything in the rings */
+typedef struct {
+    unsigned generation;
+    long frame;
+} work_t;
+
+typedef struct {
+    work_t w;
+    uint8_t cc[4];
+} pack_t;
+
+typedef struct {
+    work_t w;
+    unsigned rows; /* the rows that changed */
+    eia608_cell_t cells[EIA608_ROWS][EIA608_COLUMNS];
+} screen_t;
+
+typedef struct {
+    input_t* in;
+    int service;
+    const char* indexname;
+    int nthreads;
+    ring_t *frames, *packs, *screens;
+    atomic_int stop;
+    /* the renderer sets seek_to, then bumps generation */
+    atomic_long seek_to;
+    atomic_uint generation;
+} pipeline_t;
+
+/* wait a little while for the other end of a ring */
+static void backoff(void) {
+    struct timespec delay = {0, 500000};
+
+    nanosleep(&delay, NULL);
+}
+
+/* push, waiting for room, unless everything is stopping or the work has
+   become stale.  returns 0, or -1 if the work was dropped. */
+static int push(pipeline_t* p, ring_t* ring, const void* elem, unsigned generation) {
+    while (ring_push(ring, elem) != 0) {
+	if (atomic_load(&p->stop) || atomic_load(&p->generation) != generation)
+	    return -1;
+	backoff();
     }
+    return 0;
+}
 
-    decoder = eia608_new();
-    tc = (framesize == DV_NTSC_SIZE ? smpte_new(1, 30) : smpte_new(0, 25));
+/* pop, waiting for something to turn up.  returns 0, or -1 if everything
+   is stopping. */
+static int pop(pipeline_t* p, ring_t* ring, void* elem) {
+    while (ring_pop(ring, elem) != 0) {
+	if (atomic_load(&p->stop))
+	    return -1;
+	backoff();
+    }
+    return 0;
+}
 
-    initscr();
-    init_pair(1, COLOR_WHITE, COLOR_BLACK);
-    init_pair(2, COLOR_GREEN, COLOR_BLACK);
-    init_pair(3, COLOR_BLUE, COLOR_BLACK);
-    init_pair(4, COLOR_CYAN, COLOR_BLACK);
-    init_pair(5, COLOR_RED, COLOR_BLACK);
-    init_pair(6, COLOR_YELLOW, COLOR_BLACK);
-    init_pair(7, COLOR_MAGENTA, COLOR_BLACK);
+void* reader_thread(void* data) {
+    pipeline_t* p = (pipeline_t*)data;
+    unsigned generation = 0;
+    stage_timer_t t;
+    work_t w;
 
-    gettimeofday(&tv, NULL);
+    w.frame = 0;
+    while (!atomic_load(&p->stop)) {
+	if (atomic_load(&p->generation) != generation) {
+	    generation = atomic_load(&p->generation);
+	    w.frame = atomic_load(&p->seek_to);
+	}
+	if (w.frame >= p->in->nframes) {
+	    /* nothing more to read, unless there's a seek */
+	    backoff();
+	    continue;
+	}
+
+	if (timing)
+	    stage_start(&t);
+	read_frame(p->in, w.frame);
+	if (timing)
+	    stage_end(STAGE_READ, &t);
+
+	w.generation = generation;
+	if (push(p, p->frames, &w, generation) == 0)
+	    w.frame++;
+    }
+    return NULL;
+}
+
+void* extractor_thread(void* data) {
+    pipeline_t* p = (pipeline_t*)data;
+    stage_timer_t t;
+    pack_t pack;
+
+    while (pop(p, p->frames, &pack.w) == 0) {
+	if (pack.w.generation != atomic_load(&p->generation))
+	    continue;
+
+	if (timing)
+	    stage_start(&t);
+	if (parse_frame(p->in, pack.w.frame, pack.cc) != 0)
+	    memcpy(pack.cc, padding, 4);
+	if (timing)
+	    stage_end(STAGE_PARSE, &t);
+
+	push(p, p->packs, &pack, pack.w.generation);
+    }
+    return NULL;
+}
+
+void* decoder_thread(void* data) {
+    pipeline_t* p = (pipeline_t*)data;
+    eia608_t* decoder = eia608_new();
+    checkpoint_t* index = NULL;
+    unsigned generation = 0;
+    screen_t* screen = malloc(sizeof(screen_t));
+    pack_t pack;
+    long frame;
+    int row;
 
-    for(i = 0; i < nframes; ++i) {
-	if (uselibqt) {
-	    assert(quicktime_frame_size(qtfile, i, 0) == framesize);
-	    quicktime_read_frame(qtfile, buffer, 0);
+    eia608_set_wanted(decoder, p->service);
+
+    while (pop(p, p->packs, &pack) == 0) {
+	if (pack.w.generation != atomic_load(&p->generation))
+	    continue;
+
+	if (pack.w.generation != generation) {
+	    /* the first frame after a seek: catch up to it, by replaying
+	       from here if it's just ahead, or else from a checkpoint */
+	    generation = pack.w.generation;
+	    frame = eia608_get_frame(decoder);
+	    if (pack.w.frame < frame || pack.w.frame - frame >= CHECKPOINT_INTERVAL) {
+		if (!index)
+		    index = load_index(p->indexname, p->in, p->service, p->nthreads);
+		if (index)
+		    seek(p->in, index, decoder, pack.w.frame);
+	    }
+	    if (eia608_get_frame(decoder) != pack.w.frame)
+		seek_forward(p->in, decoder, pack.w.frame);
+	    /* and show all of it */
+	    eia608_get_changed_rows(decoder);
+	    screen->rows = (1u << EIA608_ROWS) - 1;
 	} else {
-	    read(fd, buffer, framesize);
+	    screen->rows = 0;
 	}
-	dv_parse_header(dv, buffer);
-	dv_parse_packs(dv, buffer);
 
-	if(dv_get_vaux_pack(dv, 0x65, cc) == 0) {
-	    eia608_input(decoder, cc);
-	    smpte_format(tc, tcbuf);
-	    display(tcbuf, decoder);
+	decode_frame(decoder, pack.cc);
+
+	screen->rows |= eia608_get_changed_rows(decoder);
+	if (!screen->rows)
+	    continue;
+	screen->w = pack.w;
+	for (row = 0; row < EIA608_ROWS; ++row) {
+	    memcpy(screen->cells[row], eia608_get_row(decoder, row),
+		   sizeof(screen->cells[row]));
 	}
-	tv.tv_usec += (framesize == DV_NTSC_SIZE ? (i % 3 ? 33367 : 33366) : 40000);
-	if (tv.tv_usec > 1000000) {
-	    tv.tv_usec -= 1000000;
-	    tv.tv_sec++;
+	push(p, p->screens, screen, generation);
+    }
+
+    if (index)
+	checkpoint_free(index);
+    free(screen);
+    finish_decoder(decoder);
+    return NULL;
+}
+
+/* show one service of an input in real time, from frame start.  the
+   arrow keys seek 10 s (left, right) or a minute (down, up), with the
+   help of the index in indexname, which is made if need be; q quits. */
+void play(input_t* in, int service, long start, const char* indexname, int nthreads) {
+    pipeline_t p;
+    pthread_t reader, extractor, decoder;
+    screen_t* screen = malloc(sizeof(screen_t));
+    int have_screen = 0;
+    smpte_t tc;
+    char tcbuf[SMPTE_STR_LEN];
+    int num = (in->framesize == DV_NTSC_SIZE ? 30000 : 25);
+    int den = (in->framesize == DV_NTSC_SIZE ? 1001 : 1);
+    int fps = (num + den - 1) / den;
+    unsigned generation = 1;
+    long base_frame, base_time, now, frame, shown = -1, target;
+    struct timespec delay;
+    stage_timer_t t;
+    int row, drawn;
+
+    p.in = in;
+    p.service = service;
+    p.indexname = indexname;
+    p.nthreads = nthreads;
+    p.frames = ring_new(RING_FRAMES, sizeof(work_t));
+    p.packs = ring_new(RING_FRAMES, sizeof(pack_t));
+    p.screens = ring_new(RING_SCREENS, sizeof(screen_t));
+    atomic_init(&p.stop, 0);
+    atomic_init(&p.seek_to, start);
+    atomic_init(&p.generation, generation);
+
+    pthread_create(&reader, NULL, reader_thread, &p);
+    pthread_create(&extractor, NULL, extractor_thread, &p);
+    pthread_create(&decoder, NULL, decoder_thread, &p);
+
+    printf("%i\n", in->framesize);
+    start_curses();
+    input_timecode(in, &tc);
+
+    base_frame = start;
+    base_time = clock_ns(CLOCK_MONOTONIC);
+    for (;;) {
+	now = clock_ns(CLOCK_MONOTONIC);
+	frame = base_frame + (long)((double)(now - base_time) * num / den / 1e9);
+	if (frame >= in->nframes)
+	    break;
+
+	if (timing)
+	    stage_start(&t);
+
+	/* show every screen that's due by now */
+	drawn = 0;
+	while (have_screen || ring_pop(p.screens, screen) == 0) {
+	    have_screen = 1;
+	    if (screen->w.generation != generation) {
+		have_screen = 0;
+		continue;
+	    }
+	    if (screen->w.frame > frame)
+		break;
+	    for (row = 0; row < EIA608_ROWS; ++row) {
+		if (screen->rows & (1u << row))
+		    monitor_draw_row(stdscr, row + 1, 0, screen->cells[row]);
+	    }
+	    have_screen = 0;
+	    drawn = 1;
 	}
+	if (frame != shown) {
+	    smpte_set_frame(&tc, frame);
+	    smpte_format(&tc, tcbuf);
+	    mvaddstr(0, 0, tcbuf);
+	    shown = frame;
+	    drawn = 1;
+	}
+	if (drawn)
+	    refresh();
 
-	gettimeofday(&now, NULL);
-	delay.tv_sec = 0;
-	delay.tv_nsec = 1000L*((tv.tv_usec-now.tv_usec) + 1000000*(tv.tv_sec-now.tv_sec));
+	if (timing)
+	    stage_end(STAGE_RENDER, &t);
 
-	if (delay.tv_nsec > 0)
-	    while(nanosleep(&delay, &delay));
+	target = -1;
+	switch (getch()) {
+	case KEY_LEFT:
+	    target = frame - 10*fps;
+	    break;
+	case KEY_RIGHT:
+	    target = frame + 10*fps;
+	    break;
+	case KEY_DOWN:
+	    target = frame - 60*fps;
+	    break;
+	case KEY_UP:
+	    target = frame + 60*fps;
+	    break;
+	case 'q':
+	    target = -2;
+	    break;
+	}
+	if (target == -2)
+	    break;
+	if (target != -1) {
+	    if (target < 0)
+		target = 0;
+	    if (target >= in->nframes)
+		target = in->nframes - 1;
+	    atomic_store(&p.seek_to, target);
+	    atomic_store(&p.generation, ++generation);
+	    base_frame = target;
+	    base_time = clock_ns(CLOCK_MONOTONIC);
+	    have_screen = 0;
+	    continue;
+	}
+
+	/* sleep until the next frame is due */
+	now = clock_ns(CLOCK_MONOTONIC) - base_time;
+	now = (long)((double)(frame + 1 - base_frame) * den / num * 1e9) - now;
+	if (now > 0) {
+	    delay.tv_sec = now / 1000000000L;
+	    delay.tv_nsec = now % 1000000000L;
+	    nanosleep(&delay, NULL);
+	}
+    }
+
+    endwin();
+
+    atomic_store(&p.stop, 1);
+    pthread_join(reader, NULL);
+    pthread_join(extractor, NULL);
+    pthread_join(decoder, NULL);
+
+    ring_free(p.frames);
+    ring_free(p.packs);
+    ring_free(p.screens);
+    free(screen);
+}
 
+/* everything a batch job needs to know */
+typedef struct {
+    char** names;
+    int* failed;
+    int service;
+    int format;
+} batch_t;
 
-	smpte_incr_frame(tc);
+/* where the cues for file name go: the same name with the extension
+   replaced.  the result must be freed. */
+char* sidecar_name(const char* name, int format) {
+    const char* ext = (format == SUBTITLE_VTT ? ".vtt" :
+		       format == FORMAT_SCC ? ".scc" : ".srt");
+    const char* slash = strrchr(name, '/');
+    const char* dot = strrchr(name, '.');
+    size_t len = (dot && (!slash || dot > slash)) ? (size_t)(dot - name) : strlen(name);
+    char* out = malloc(len + strlen(ext) + 1);
+
+    if (out) {
+	memcpy(out, name, len);
+	strcpy(out + len, ext);
+    }
+    return out;
+}
+
+/* a pool_job_fn; every job has its own input, decoder and output */
+void batch_job(void* data, long job, int worker) {
+    batch_t* batch = (batch_t*)data;
+    const char* name = batch->names[job];
+    char* outname;
+    int kind = input_kind(name);
+    input_t in;
+    FILE* out;
+    int ret;
+
+    batch->failed[job] = 1;
+
+    /* words for the index have no sidecar */
+    outname = batch->format == FORMAT_INDEX ? NULL : sidecar_name(name, batch->format);
+    if (outname && strcmp(outname, name) == 0) {
+	fprintf(stderr, "%s: would be written over\n", name);
+	free(outname);
+	return;
+    }
+
+    if (kind == INPUT_DV && open_input(name, &in) != 0) {
+	free(outname);
+	return;
+    }
+
+    out = outname ? fopen(outname, "w") : NULL;
+    if (!out && batch->format != FORMAT_INDEX) {
+	perror(outname ? outname : name);
+    } else {
+	if (kind == INPUT_DV)
+	    ret = write_cues(&in, out, batch->service, batch->format, 1, NULL);
+	else
+	    ret = caption_cues(kind, name, out, batch->service, batch->format);
+	if (ret == 0)
+	    batch->failed[job] = 0;
+	if (out && fclose(out) != 0) {
+	    perror(outname);
+	    batch->failed[job] = 1;
+	}
     }
 
+    free(outname);
+    if (kind == INPUT_DV)
+	close_input(&in);
+}
+
+/* add a copy of name to the *count names in *names.  returns 0, or prints
+   why not and returns -1. */
+int add_name(char*** names, int* count, const char* name) {
+    char** grown = realloc(*names, (*count + 1) * sizeof(char*));
+    char* copy = strdup(name);
+
+    if (grown)
+	*names = grown;
+    if (!grown || !copy) {
+	perror(name);
+	free(copy);
+	return -1;
+    }
+    (*names)[(*count)++] = copy;
+    return 0;
+}
+
+/* add the file names listed one per line in list to *names.  returns 0,
+   or prints why not and returns -1. */
+int read_list(const char* list, char*** names, int* count) {
+    FILE* f = strcmp(list, "-") == 0 ? stdin : fopen(list, "r");
+    char* line = NULL;
+    size_t size = 0;
+    ssize_t len;
+
+    if (!f) {
+	perror(list);
+	return -1;
+    }
+
+    while ((len = getline(&line, &size, f)) >= 0) {
+	while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+	    line[--len] = '\0';
+	if (len == 0)
+	    continue;
+
+	if (add_name(names, count, line) != 0)
+	    break;
+    }
+
+    free(line);
+    if (f != stdin)
+	fclose(f);
+    return len >= 0 ? -1 : 0;
+}
+
+/* one of the inputs being monitored: a file, played in real time, or a
+   stream, shown as it comes in */
+typedef struct {
+    input_t in;
+    eia608_multi_t* multi;
+    long next; /* the next frame to decode */
+    int num, den; /* frames per second */
+    /* for a stream, a thread reads it and passes the packs along */
+    const char* name;
+    int fd;
+    dvstream_t* stream;
+    ring_t* packs;
+    pthread_t reader;
+    atomic_int ended;
+} feed_t;
+
+#define FEED_CHUNK 256
+#define RING_PACKS 4096
+
+/* read a feed's stream until it ends; a pthread start routine */
+void* stream_thread(void* data) {
+    feed_t* f = (feed_t*)data;
+    uint8_t cc[4];
+
+    while (stream_cc(f->name, f->stream, cc) > 0) {
+	/* if the screen falls behind, let the stream back up */
+	while (ring_push(f->packs, cc) != 0)
+	    backoff();
+    }
+    atomic_store(&f->ended, 1);
+    return NULL;
+}
+
+static void feed_batch(feed_t* f, const uint8_t* bytes, long n) {
+    stage_timer_t t;
+
+    if (timing)
+	stage_start(&t);
+    eia608_multi_input_batch(f->multi, bytes, n);
+    if (timing)
+	stage_end(STAGE_DECODE, &t);
+    f->next += n;
+}
+
+/* decode a feed's frames up to, not including, frame end; or for a
+   stream, everything that has come in so far.  returns 0, or -1 if
+   there's nothing left to decode. */
+int feed(feed_t* f, long end) {
+    uint8_t bytes[FEED_CHUNK * 4];
+    int ended;
+    long n;
+
+    if (f->stream) {
+	ended = atomic_load(&f->ended);
+	do {
+	    for (n = 0; n < FEED_CHUNK && ring_pop(f->packs, bytes + 4*n) == 0; ++n)
+		;
+	    feed_batch(f, bytes, n);
+	} while (n == FEED_CHUNK);
+	return ended ? -1 : 0;
+    }
+
+    if (end > f->in.nframes)
+	end = f->in.nframes;
+
+    while (f->next < end) {
+	for (n = 0; n < FEED_CHUNK && f->next + n < end; ++n) {
+	    if (extract_cc(&f->in, f->next + n, bytes + 4*n) != 0)
+		memcpy(bytes + 4*n, padding, 4);
+	}
+	feed_batch(f, bytes, n);
+    }
+    return f->next < f->in.nframes ? 0 : -1;
+}
+
+/* start a feed from a file or a stream.  returns 0, or -1 if it couldn't
+   be opened. */
+int open_feed(feed_t* f, const char* name) {
+    f->name = name;
+    if (!is_stream(name)) {
+	if (open_input(name, &f->in) != 0)
+	    return -1;
+	f->num = (f->in.framesize == DV_NTSC_SIZE ? 30000 : 25);
+	f->den = (f->in.framesize == DV_NTSC_SIZE ? 1001 : 1);
+	f->multi = eia608_multi_new();
+	return 0;
+    }
+
+    f->fd = open_stream(name);
+    if (f->fd < 0)
+	return -1;
+    f->stream = dvstream_new(f->fd);
+    f->packs = ring_new(RING_PACKS, 4);
+    atomic_init(&f->ended, 0);
+    if (pthread_create(&f->reader, NULL, stream_thread, f) != 0) {
+	fprintf(stderr, "couldn't start a thread for %s.\n", name);
+	ring_free(f->packs);
+	close_stream(name, f->fd, f->stream);
+	return -1;
+    }
+    f->multi = eia608_multi_new();
+    return 0;
+}
+
+void close_feed(feed_t* f) {
+    finish_multi(f->multi);
+    if (!f->stream) {
+	close_input(&f->in);
+	return;
+    }
+
+    /* the reader might be waiting on a stream that hasn't ended */
+    pthread_cancel(f->reader);
+    pthread_join(f->reader, NULL);
+    ring_free(f->packs);
+    close_stream(f->name, f->fd, f->stream);
+}
+
+/* show several services of several inputs at once, a pane each, all
+   playing in real time.  the screen is brought up to date at most rate
+   times a second, and then only where it has changed.  q quits.  returns
+   0, or -1 if an input couldn't be opened. */
+int monitor(char** names, int nnames, const int* services, int nservices, int rate) {
+    feed_t* feeds = calloc(nnames, sizeof(feed_t));
+    monitor_t* mon;
+    char title[EIA608_COLUMNS + 1], status[128];
+    const char* base;
+    long start, now, next_tick, tick, secs;
+    struct timespec delay;
+    stage_timer_t t;
+    int i, j, done;
+
+    for (i = 0; i < nnames; ++i) {
+	if (open_feed(&feeds[i], names[i]) != 0) {
+	    while (i-- > 0)
+		close_feed(&feeds[i]);
+	    free(feeds);
+	    return -1;
+	}
+    }
+
+    start_curses();
+    mon = monitor_new(nnames * nservices);
+    for (i = 0; i < nnames; ++i) {
+	base = strrchr(names[i], '/');
+	base = base ? base + 1 : names[i];
+	for (j = 0; j < nservices; ++j) {
+	    snprintf(title, sizeof(title), " %s %s ", eia608_service_name(services[j]), base);
+	    monitor_set_pane(mon, i * nservices + j, title,
+			     eia608_multi_get(feeds[i].multi, services[j]));
+	}
+    }
+
+    tick = 1000000000L / rate;
+    start = next_tick = clock_ns(CLOCK_MONOTONIC);
+    do {
+	/* catch every input up with the clock */
+	now = clock_ns(CLOCK_MONOTONIC) - start;
+	done = 1;
+	for (i = 0; i < nnames; ++i) {
+	    if (feed(&feeds[i], feeds[i].stream ? 0 :
+		     (long)((double)now * feeds[i].num / feeds[i].den / 1e9) + 1) == 0)
+		done = 0;
+	}
+
+	secs = now / 1000000000L;
+	snprintf(status, sizeof(status), "%02ld:%02ld:%02ld  %d of %d panes shown  q quits",
+		 secs / 3600, secs / 60 % 60, secs % 60,
+		 monitor_shown(mon), nnames * nservices);
+	if (timing)
+	    stage_start(&t);
+	monitor_render(mon, status);
+	if (timing)
+	    stage_end(STAGE_RENDER, &t);
+
+	/* then wait for the next tick, skipping any that have been missed */
+	next_tick += tick;
+	now = clock_ns(CLOCK_MONOTONIC);
+	if (next_tick < now)
+	    next_tick = now;
+	delay.tv_sec = (next_tick - now) / 1000000000L;
+	delay.tv_nsec = (next_tick - now) % 1000000000L;
+	while (nanosleep(&delay, &delay))
+	    ;
+    } while (!done && getch() != 'q');
+
+    monitor_free(mon);
     endwin();
-    dv_decoder_free(dv);
-    smpte_free(tc);
-    eia608_free(decoder);
-    free(buffer);
-    if (uselibqt)
-	quicktime_close(qtfile);
+
+    for (i = 0; i < nnames; ++i) {
+	close_feed(&feeds[i]);
+    }
+    free(feeds);
 
     return 0;
 }
+
+int main(int argc, char** argv) {
+    input_t in;
+    int opt, i;
+    int nthreads = 1;
+    int service = EIA608_CC1;
+    int services[8];
+    int nservices = 0;
+    int monitoring = 0;
+    int rate = 10;
+    int format = -1;
+    const char* outname = NULL;
+    const char* list = NULL;
+    const char* indexname = NULL;
+    checkpoint_t* index = NULL;
+    const char* startarg = NULL;
+    const char* searchname = NULL;
+    long start = 0;
+    FILE* out = stdout;
+    char** names = NULL;
+    int nnames = 0;
+    int ret = 0;
+    batch_t batch;
+    long wall = clock_ns(CLOCK_MONOTONIC);
+    long cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+
+    setlocale(LC_ALL, "");
+
+    while ((opt = getopt(argc, argv, "s:f:o:j:l:c:t:vmr:g:x:")) != -1) {
+	switch (opt) {
+	case 's':
+	    service = eia608_parse_service(optarg);
+	    if (service < 0) {
+		fprintf(stderr, "unknown service %s.\n", optarg);
+		return 1;
+	    }
+	    if (nservices < 8)
+		services[nservices++] = service;
+	    break;
+	case 'f':
+	    if (strcmp(optarg, "srt") == 0) {
+		format = SUBTITLE_SRT;
+	    } else if (strcmp(optarg, "vtt") == 0) {
+		format = SUBTITLE_VTT;
+	    } else if (strcmp(optarg, "scc") == 0) {
+		format = FORMAT_SCC;
+	    } else {
+		fprintf(stderr, "unknown output format %s.\n", optarg);
+		return 1;
+	    }
+	    break;
+	case 'o':
+	    outname = optarg;
+	    break;
+	case 'j':
+	    nthreads = atoi(optarg);
+	    break;
+	case 'l':
+	    list = optarg;
+	    break;
+	case 'c':
+	    indexname = optarg;
+	    break;
+	case 't':
+	    startarg = optarg;
+	    break;
+	case 'v':
+	    timing = 1;
+	    break;
+	case 'm':
+	    monitoring = 1;
+	    break;
+	case 'r':
+	    rate = atoi(optarg);
+	    if (rate <= 0) {
+		fprintf(stderr, "bad rate %s.\n", optarg);
+		return 1;
+	    }
+	    break;
+	case 'x':
+	    searchname = optarg;
+	    break;
+	case 'g':
+	    if (sscanf(optarg, "%dx%d", &raw_width, &raw_height) != 2 ||
+		raw_width <= 0 || raw_height <= 0) {
+		fprintf(stderr, "bad frame size %s.\n", optarg);
+		return 1;
+	    }
+	    break;
+	default:
+	    usage(argv[0]);
+	    return 1;
+	}
+    }
+
+    for (i = optind; i < argc; ++i) {
+	if (add_name(&names, &nnames, argv[i]) != 0)
+	    return 1;
+    }
+    if (list && read_list(list, &names, &nnames) != 0)
+	return 1;
+    if (searchname) {
+	if (format >= 0 || outname) {
+	    usage(argv[0]);
+	    return 1;
+	}
+	format = FORMAT_INDEX;
+    }
+
+    if (nnames == 0 || ((nnames > 1 || list) && !monitoring && (format < 0 || outname)) ||
+	((nnames > 1 || list) && indexname) || (format >= 0 && startarg) ||
+	(monitoring && (format >= 0 || outname || indexname || startarg))) {
+	usage(argv[0]);
+	return 1;
+    }
+
+    if (searchname) {
+	caption_index_name = searchname;
+	caption_index = ccindex_writer_new(searchname);
+	if (!caption_index) {
+	    perror(searchname);
+	    return 1;
+	}
+    }
+
+    if (monitoring) {
+	if (nservices == 0)
+	    services[nservices++] = service;
+	if (monitor(names, nnames, services, nservices, rate) != 0)
+	    ret = 1;
+    } else if (nnames > 1 || list) {
+	/* batch mode: files at once, one thread each, cues in sidecars */
+	batch.names = names;
+	batch.failed = calloc(nnames, sizeof(int));
+	batch.service = service;
+	batch.format = format;
+
+	if (pool_run(nnames, nthreads, batch_job, &batch) != 0) {
+	    fprintf(stderr, "couldn't start worker threads.\n");
+	    ret = 1;
+	}
+	for (i = 0; i < nnames; ++i) {
+	    if (batch.failed[i]) {
+		fprintf(stderr, "%s: failed\n", names[i]);
+		ret = 1;
+	    }
+	}
+	free(batch.failed);
+    } else if (!is_stream(names[0]) && input_kind(names[0]) != INPUT_DV) {
+	/* captions without DV: nothing to show in real time or seek */
+	if (format < 0 || indexname) {
+	    fprintf(stderr, "%s isn't DV, so can only be written out with -f.\n", names[0]);
+	    ret = 1;
+	} else {
+	    if (outname) {
+		out = fopen(outname, "w");
+		if (!out) {
+		    perror(outname);
+		    return 1;
+		}
+	    }
+	    if (caption_cues(input_kind(names[0]), names[0], out, service, format) != 0)
+		ret = 1;
+	    if (outname)
+		fclose(out);
+	}
+    } else if (is_stream(names[0])) {
+	/* no seeking in a stream, so it is shown like a monitored feed */
+	if (indexname || startarg) {
+	    fprintf(stderr, "%s can't be seeked in.\n", names[0]);
+	    ret = 1;
+	} else if (format >= 0) {
+	    if (outname) {
+		out = fopen(outname, "w");
+		if (!out) {
+		    perror(outname);
+		    return 1;
+		}
+	    }
+	    if (stream_cues(names[0], out, service, format) != 0)
+		ret = 1;
+	    if (outname)
+		fclose(out);
+	} else if (monitor(names, 1, &service, 1, rate) != 0) {
+	    ret = 1;
+	}
+    } else {
+	if (open_input(names[0], &in) != 0)
+	    return 1;
+
+	if (format >= 0) {
+	    /* no curses, no pacing, just cues */
+	    if (outname) {
+		out = fopen(outname, "w");
+		if (!out) {
+		    perror(outname);
+		    return 1;
+		}
+	    }
+	    if (indexname)
+		index = checkpoint_new(CHECKPOINT_INTERVAL);
+	    if (write_cues(&in, out, service, format, nthreads, index) != 0)
+		ret = 1;
+	    if (outname)
+		fclose(out);
+	    if (index) {
+		if (ret == 0 && save_index(indexname, index) != 0)
+		    ret = 1;
+		checkpoint_free(index);
+	    }
+	} else {
+	    if (startarg)
+		start = parse_start(&in, startarg);
+	    if (start >= 0)
+		play(&in, service, start, indexname, nthreads);
+	    else {
+		fprintf(stderr, "%s is neither a timecode nor a frame.\n", startarg);
+		ret = 1;
+	    }
+	}
+
+	close_input(&in);
+    }
+
+    if (caption_index && ccindex_writer_close(caption_index) != 0) {
+	perror(searchname);
+	ret = 1;
+    }
+
+    for (i = 0; i < nnames; ++i) {
+	free(names[i]);
+    }
+    free(names);
+
+    if (timing)
+	print_timing(clock_ns(CLOCK_MONOTONIC) - wall,
+		     clock_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu);
+
+    return ret;
+}
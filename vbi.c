@@ -0,0 +1,563 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Primary references:
+ * CEA-608, Line 21 Data Services (the waveform and its timing)
+ * ITU-R BT.601, Studio Encoding Parameters of Digital Television (how
+ * much of the line 720 samples cover)
+ * YUV4MPEG2, as written by mjpegtools and FFmpeg, which is only
+ * described by their source
+ */
+
+/*
+ * A line is cut halfway between the lowest and highest samples of its
+ * first half, where the run-in is, into a plane of bits, 32 samples to a
+ * word, several at a time; the rising edges in that are where each cycle
+ * of the run-in starts.  five or more evenly spaced ones, then a gap the
+ * size of the two zero bits and the start bit's edge after it, give the
+ * bit period and where the bits are, and each bit is read off the plane
+ * as the majority of the three samples at its middle.  only the rows
+ * near the top of each frame are read at all, when the file can seek.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "vbi.h"
+
+/* the bit rate is 32 times the line rate, 503.5 kHz, which at the 13.5
+   MHz of a 720-sample line is 26.81 samples a bit.  periods and edges
+   are kept in 256ths of a sample. */
+#define BIT_720        6864
+#define MIN_WIDTH      256
+#define MAX_WIDTH      2048
+
+#define RUNIN_EDGES    5  /* the fewest run-in cycles to lock on to */
+#define MIN_SWING      32 /* between the lowest and highest samples */
+#define MAX_EDGES      64
+#define DATA_BITS      17 /* the start bit and two bytes */
+
+#define SEARCH_ROWS    48 /* how far down a frame line 21 can be */
+#define RELOCK         30 /* frames it can be missing before it's looked for again */
+#define MAX_FRAME_SIDE 8192
+#define Y4M_LINE       256
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#if defined(__AVX2__)
+#define VEC_BYTES 32
+#define vec_t __m256i
+#define vec_load(p) _mm256_loadu_si256((const __m256i*)(p))
+#define vec_store(p, v) _mm256_storeu_si256((__m256i*)(p), v)
+#define vec_set1(b) _mm256_set1_epi8(b)
+#define vec_min _mm256_min_epu8
+#define vec_max _mm256_max_epu8
+#define vec_xor _mm256_xor_si256
+#define vec_cmpgt _mm256_cmpgt_epi8
+#define vec_movemask(v) ((uint32_t)_mm256_movemask_epi8(v))
+#else
+#define VEC_BYTES 16
+#define vec_t __m128i
+#define vec_load(p) _mm_loadu_si128((const __m128i*)(p))
+#define vec_store(p, v) _mm_storeu_si128((__m128i*)(p), v)
+#define vec_set1(b) _mm_set1_epi8(b)
+#define vec_min _mm_min_epu8
+#define vec_max _mm_max_epu8
+#define vec_xor _mm_xor_si128
+#define vec_cmpgt _mm_cmpgt_epi8
+#define vec_movemask(v) ((uint32_t)_mm_movemask_epi8(v))
+#endif
+#endif
+
+/* the lowest and highest of n samples */
+static void levels(const uint8_t* luma, int n, int* lo, int* hi) {
+    int l = 255, h = 0, i = 0;
+#ifdef VEC_BYTES
+    uint8_t lanes[2][VEC_BYTES];
+    vec_t vl, vh, v;
+    int j;
+
+    if (n >= VEC_BYTES) {
+	vl = vh = vec_load(luma);
+	for (i = VEC_BYTES; i + VEC_BYTES <= n; i += VEC_BYTES) {
+	    v = vec_load(luma + i);
+	    vl = vec_min(vl, v);
+	    vh = vec_max(vh, v);
+	}
+	vec_store(lanes[0], vl);
+	vec_store(lanes[1], vh);
+	for (j = 0; j < VEC_BYTES; ++j) {
+	    if (lanes[0][j] < l)
+		l = lanes[0][j];
+	    if (lanes[1][j] > h)
+		h = lanes[1][j];
+	}
+    }
+#endif
+    for (; i < n; ++i) {
+	if (luma[i] < l)
+	    l = luma[i];
+	if (luma[i] > h)
+	    h = luma[i];
+    }
+    *lo = l;
+    *hi = h;
+}
+
+/* set bit i of bits where sample i is above level.  there's no unsigned
+   byte compare, so both sides are moved down by 128 first. */
+static void threshold(const uint8_t* luma, int n, int level, uint32_t* bits) {
+    int i = 0;
+#ifdef VEC_BYTES
+    vec_t bias = vec_set1((char)0x80);
+    vec_t t = vec_set1((char)(level ^ 0x80));
+
+    for (; i + 32 <= n; i += 32) {
+#if VEC_BYTES == 32
+	bits[i / 32] = vec_movemask(vec_cmpgt(vec_xor(vec_load(luma + i), bias), t));
+#else
+	bits[i / 32] = vec_movemask(vec_cmpgt(vec_xor(vec_load(luma + i), bias), t)) |
+	    vec_movemask(vec_cmpgt(vec_xor(vec_load(luma + i + 16), bias), t)) << 16;
+#endif
+    }
+#endif
+    for (; i < n; ++i) {
+	if (i % 32 == 0)
+	    bits[i / 32] = 0;
+	bits[i / 32] |= (uint32_t)(luma[i] > level) << (i % 32);
+    }
+}
+
+static inline int bit_at(const uint32_t* bits, int i) {
+    return (bits[i / 32] >> (i % 32)) & 1;
+}
+
+/* find the rising edges in the bits of n samples, placing each between
+   the two samples either side of level.  an edge needs two samples
+   above the level after one below, so that noise as the waveform falls
+   through the level isn't taken for one; bits has a zero word after the
+   last for that.  returns how many edges there are. */
+static int rising_edges(const uint8_t* luma, const uint32_t* bits, int n, int level,
+			int* edge) {
+    uint32_t prev = 0x80000000; /* no edge at the very first sample */
+    uint32_t e;
+    int count = 0, w, i, a, b;
+
+    for (w = 0; w < (n + 31) / 32; ++w) {
+	e = bits[w] & ((bits[w] >> 1) | (bits[w + 1] << 31)) &
+	    ~((bits[w] << 1) | (prev >> 31));
+	prev = bits[w];
+	while (e) {
+	    i = 32 * w + __builtin_ctz(e);
+	    e &= e - 1;
+	    a = luma[i - 1];
+	    b = luma[i];
+	    edge[count++] = 256 * (i - 1) + (256 * (level - a) + 128) / (b - a);
+	    if (count == MAX_EDGES)
+		return count;
+	}
+    }
+    return count;
+}
+
+/* read the start bit and two bytes, the start bit's edge being at start
+   and the bits period apart */
+static int read_bits(const uint32_t* bits, int width, int start, int period,
+		     uint8_t pair[2]) {
+    unsigned word = 0;
+    int k, c, b;
+
+    for (k = 0; k < DATA_BITS; ++k) {
+	c = (start + k * period + period / 2) / 256;
+	if (c + 1 >= width)
+	    return 0;
+	b = bit_at(bits, c - 1) + bit_at(bits, c) + bit_at(bits, c + 1) >= 2;
+	if (k == 0 && !b)
+	    return 0;
+	if (k > 0)
+	    word |= b << (k - 1);
+    }
+
+    pair[0] = word & 0xFF;
+    pair[1] = word >> 8;
+    return 1;
+}
+
+int vbi_slice(const uint8_t* luma, int width, uint8_t pair[2]) {
+    uint32_t bits[MAX_WIDTH / 32 + 1];
+    int edge[MAX_EDGES];
+    int nominal = width * BIT_720 / 720;
+    int lo, hi, level, n, i, j, period, gap;
+
+    if (width < MIN_WIDTH || width > MAX_WIDTH)
+	return 0;
+    levels(luma, width / 2, &lo, &hi);
+    if (hi - lo < MIN_SWING)
+	return 0;
+    level = (lo + hi) / 2;
+    threshold(luma, width, level, bits);
+    bits[(width + 31) / 32] = 0;
+    n = rising_edges(luma, bits, width, level, edge);
+
+    /* the run-in is a stretch of edges about a bit apart, its last cycle
+       followed by the two zero bits, so that the next edge, the start
+       bit's, is nearly three bits after it */
+    for (i = 0; i < n; i = j) {
+	for (j = i + 1; j < n && abs(edge[j] - edge[j - 1] - nominal) < nominal / 4; ++j)
+	    ;
+	if (j - i < RUNIN_EDGES || j == n)
+	    continue;
+	period = (edge[j - 1] - edge[i]) / (j - i - 1);
+	gap = edge[j] - edge[j - 1];
+	if (gap >= 2 * period && gap <= 7 * period / 2 &&
+	    read_bits(bits, width, edge[j], period, pair))
+	    return 1;
+    }
+    return 0;
+}
+
+struct __vbi_struct {
+    int fd, format;
+    int width, height;
+    int shift;         /* to take Y4M samples down to 8 bits */
+    int bytes;         /* a sample, in a Y4M stream */
+    size_t stride;     /* bytes from one row of the luma to the next */
+    size_t frame_size; /* bytes of picture a frame, after any header */
+    int rows;          /* how many rows from the top are read */
+    int seekable;
+    off_t pos;
+    int started, eof;
+    char error[80];
+
+    uint8_t* buf;      /* those rows, or from a pipe the whole frame */
+    uint8_t* luma;     /* one of the rows, as 8-bit luma */
+    int row1, row2;    /* where line 21 of each field has been, or -1 */
+    int missed;        /* frames line 21 of field 1 hasn't been on row1 */
+    long frame;        /* the next to be read */
+};
+
+vbi_t* vbi_new(int fd, int format, int width, int height) {
+    vbi_t* vbi = calloc(1, sizeof(vbi_t));
+    struct stat st;
+
+    vbi->fd = fd;
+    vbi->format = format;
+    vbi->width = width;
+    vbi->height = height;
+    vbi->row1 = vbi->row2 = -1;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+	vbi->pos = lseek(fd, 0, SEEK_CUR);
+	vbi->seekable = vbi->pos >= 0;
+    }
+    return vbi;
+}
+
+void vbi_free(vbi_t* vbi) {
+    free(vbi->buf);
+    free(vbi->luma);
+    free(vbi);
+}
+
+const char* vbi_error(vbi_t* vbi) {
+    return vbi->error;
+}
+
+void vbi_rows(vbi_t* vbi, int* field1, int* field2) {
+    *field1 = vbi->row1;
+    *field2 = vbi->row2;
+}
+
+/* read len bytes where the video is up to.  returns 0, 1 at the end, or
+   -1 on an error. */
+static int get(vbi_t* vbi, uint8_t* p, size_t len) {
+    size_t got = 0;
+    ssize_t n;
+
+    while (got < len) {
+	if (vbi->seekable)
+	    n = pread(vbi->fd, p + got, len - got, vbi->pos + got);
+	else
+	    n = read(vbi->fd, p + got, len - got);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n < 0) {
+	    snprintf(vbi->error, sizeof(vbi->error), "%s", strerror(errno));
+	    return -1;
+	}
+	if (n == 0)
+	    return 1;
+	got += n;
+    }
+    vbi->pos += len;
+    return 0;
+}
+
+/* read the rest of a Y4M header line, the first len bytes of which are
+   already in line, and end it at the newline.  parameters past what
+   line holds are dropped. */
+static int get_line(vbi_t* vbi, char* line, int len) {
+    int ret;
+
+    while (len == 0 || line[len - 1] != '\n') {
+	if (len == Y4M_LINE - 1)
+	    len--;
+	ret = get(vbi, (uint8_t*)line + len, 1);
+	if (ret != 0)
+	    return ret;
+	len++;
+    }
+    line[len - 1] = '\0';
+    return 0;
+}
+
+/* the size and sampling of a Y4M stream, from its header */
+static int y4m_header(vbi_t* vbi) {
+    char line[Y4M_LINE];
+    const char* colorspace = "420jpeg";
+    size_t luma, chroma;
+    char* p;
+    int depth = 8;
+
+    if (get(vbi, (uint8_t*)line, 10) != 0 || memcmp(line, "YUV4MPEG2 ", 10) != 0 ||
+	get_line(vbi, line, 0) != 0) {
+	snprintf(vbi->error, sizeof(vbi->error), "not a YUV4MPEG2 stream");
+	return -1;
+    }
+
+    for (p = strtok(line, " "); p; p = strtok(NULL, " ")) {
+	if (p[0] == 'W')
+	    vbi->width = atoi(p + 1);
+	else if (p[0] == 'H')
+	    vbi->height = atoi(p + 1);
+	else if (p[0] == 'C')
+	    colorspace = p + 1;
+    }
+    if (vbi->width <= 0 || vbi->width > MAX_FRAME_SIDE ||
+	vbi->height <= 0 || vbi->height > MAX_FRAME_SIDE)
+	return 0; /* caught by the caller */
+
+    /* 420jpeg, 420paldv, 422, 444alpha, 422p10, mono, mono16 ... */
+    luma = (size_t)vbi->width * vbi->height;
+    if (strncmp(colorspace, "420", 3) == 0) {
+	chroma = 2 * (size_t)((vbi->width + 1) / 2) * ((vbi->height + 1) / 2);
+    } else if (strncmp(colorspace, "422", 3) == 0) {
+	chroma = 2 * (size_t)((vbi->width + 1) / 2) * vbi->height;
+    } else if (strncmp(colorspace, "444", 3) == 0) {
+	chroma = 2 * luma;
+    } else if (strncmp(colorspace, "mono", 4) == 0) {
+	chroma = 0;
+	if (colorspace[4] >= '0' && colorspace[4] <= '9')
+	    depth = atoi(colorspace + 4);
+    } else {
+	snprintf(vbi->error, sizeof(vbi->error), "can't read Y4M colorspace %.32s", colorspace);
+	return -1;
+    }
+    if (chroma && colorspace[3] == 'p' && colorspace[4] >= '0' && colorspace[4] <= '9')
+	depth = atoi(colorspace + 4);
+    if (strstr(colorspace, "alpha"))
+	chroma += luma;
+    if (depth < 8 || depth > 16) {
+	snprintf(vbi->error, sizeof(vbi->error), "can't read %d-bit Y4M", depth);
+	return -1;
+    }
+
+    vbi->bytes = depth > 8 ? 2 : 1;
+    vbi->shift = depth - 8;
+    vbi->stride = vbi->bytes * (size_t)vbi->width;
+    vbi->frame_size = vbi->bytes * (luma + chroma);
+    return 0;
+}
+
+/* work out the frame size and make room for the rows to be read */
+static int start(vbi_t* vbi) {
+    vbi->started = 1;
+
+    switch (vbi->format) {
+    case VBI_Y4M:
+	if (y4m_header(vbi) != 0)
+	    return -1;
+	break;
+    case VBI_UYVY:
+	vbi->stride = 2 * (size_t)vbi->width;
+	break;
+    case VBI_V210:
+	/* rows are padded to a multiple of 48 pixels */
+	vbi->stride = (size_t)(vbi->width + 47) / 48 * 128;
+	break;
+    }
+    if (vbi->width <= 0 || vbi->width > MAX_FRAME_SIDE ||
+	vbi->height <= 0 || vbi->height > MAX_FRAME_SIDE) {
+	snprintf(vbi->error, sizeof(vbi->error), "bad frame size %dx%d",
+		 vbi->width, vbi->height);
+	return -1;
+    }
+    if (vbi->format != VBI_Y4M)
+	vbi->frame_size = vbi->stride * vbi->height;
+
+    vbi->rows = vbi->height < SEARCH_ROWS ? vbi->height : SEARCH_ROWS;
+    vbi->buf = malloc(vbi->seekable ? vbi->rows * vbi->stride : vbi->frame_size);
+    vbi->luma = malloc(vbi->width);
+    if (!vbi->buf || !vbi->luma) {
+	snprintf(vbi->error, sizeof(vbi->error), "out of memory");
+	return -1;
+    }
+    return 0;
+}
+
+static inline uint32_t le32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* row r of the frame just read, as 8-bit luma */
+static const uint8_t* row_luma(vbi_t* vbi, int r) {
+    const uint8_t* p = vbi->buf + r * vbi->stride;
+    uint8_t* y = vbi->luma;
+    uint8_t six[6];
+    uint32_t w[4];
+    int i, j, v;
+
+    switch (vbi->format) {
+    case VBI_Y4M:
+	if (vbi->bytes == 1)
+	    return p;
+	for (i = 0; i < vbi->width; ++i) {
+	    v = (p[2*i] | (p[2*i + 1] << 8)) >> vbi->shift;
+	    y[i] = v > 255 ? 255 : v;
+	}
+	break;
+    case VBI_UYVY:
+	for (i = 0; i < vbi->width; ++i) {
+	    y[i] = p[2*i + 1];
+	}
+	break;
+    case VBI_V210:
+	/* Cb Y Cr, Y Cb Y, Cr Y Cb, Y Cr Y: six 10-bit Ys in 16 bytes */
+	for (i = 0; i < vbi->width; i += 6, p += 16) {
+	    for (j = 0; j < 4; ++j) {
+		w[j] = le32(p + 4*j);
+	    }
+	    six[0] = w[0] >> 12;
+	    six[1] = w[1] >> 2;
+	    six[2] = w[1] >> 22;
+	    six[3] = w[2] >> 12;
+	    six[4] = w[3] >> 2;
+	    six[5] = w[3] >> 22;
+	    memcpy(y + i, six, vbi->width - i < 6 ? vbi->width - i : 6);
+	}
+	break;
+    }
+    return y;
+}
+
+static int slice_row(vbi_t* vbi, int r, uint8_t pair[2]) {
+    return r >= 0 && r < vbi->rows && vbi_slice(row_luma(vbi, r), vbi->width, pair);
+}
+
+/* read the next frame and slice its line 21s into cc, setting *have if
+   either field had captions.  returns 0, 1 at the end, or -1 on an
+   error. */
+static int next_frame(vbi_t* vbi, uint8_t cc[4], int* have) {
+    char line[Y4M_LINE];
+    size_t len;
+    int ret, r;
+
+    if (vbi->format == VBI_Y4M) {
+	ret = get(vbi, (uint8_t*)line, 6);
+	if (ret != 0)
+	    return ret;
+	if (memcmp(line, "FRAME", 5) != 0) {
+	    snprintf(vbi->error, sizeof(vbi->error), "lost track of the Y4M frames");
+	    return -1;
+	}
+	ret = get_line(vbi, line, 6);
+	if (ret != 0)
+	    return ret;
+    }
+
+    len = vbi->seekable ? vbi->rows * vbi->stride : vbi->frame_size;
+    ret = get(vbi, vbi->buf, len);
+    if (ret != 0)
+	return ret;
+    vbi->pos += vbi->frame_size - len;
+
+    /* line 284 is the row under line 21 */
+    memset(cc, 0x80, 4);
+    *have = 0;
+    if (vbi->row1 >= 0 && slice_row(vbi, vbi->row1, cc)) {
+	vbi->missed = 0;
+	*have = 1;
+    } else if (vbi->row1 >= 0 && ++vbi->missed > RELOCK) {
+	vbi->row1 = vbi->row2 = -1;
+    }
+    for (r = 0; vbi->row1 < 0 && r < vbi->rows; ++r) {
+	if (slice_row(vbi, r, cc)) {
+	    vbi->row1 = r;
+	    vbi->missed = 0;
+	    *have = 1;
+	}
+    }
+    if (vbi->row1 >= 0 && slice_row(vbi, vbi->row1 + 1, cc + 2)) {
+	vbi->row2 = vbi->row1 + 1;
+	*have = 1;
+    }
+    return 0;
+}
+
+long vbi_read(vbi_t* vbi, uint8_t* bytes, long max, long* first) {
+    long n = 0;
+    int ret, have;
+
+    if (!vbi->started && start(vbi) != 0)
+	return -1;
+    if (!vbi->buf)
+	return -1;
+
+    while (n < max && !vbi->eof) {
+	ret = next_frame(vbi, bytes + 4*n, &have);
+	if (ret < 0)
+	    return -1;
+	if (ret > 0) {
+	    vbi->eof = 1;
+	    break;
+	}
+	vbi->frame++;
+
+	/* a run stops short of a frame without captions */
+	if (!have) {
+	    if (n > 0)
+		break;
+	    continue;
+	}
+	if (n == 0)
+	    *first = vbi->frame - 1;
+	n++;
+    }
+
+    return n;
+}
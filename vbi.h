@@ -0,0 +1,66 @@
+/*
+ * EIA-608 Closed Caption Decoder Library
+ * Copyright 2007 Michael Castleman
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __VBI_H
+#define __VBI_H
+
+#include <inttypes.h>
+
+/*
+ * Line-21 captions as they went out on the air: seven cycles of clock
+ * run-in, two zero bits, a start bit and then the two bytes, least
+ * significant bit first, drawn into the picture on line 21 of field 1
+ * and line 284 of field 2.  the slicer finds them in a row of luma
+ * samples that covers the active line, whatever its width.
+ */
+
+/* slice one line of width 8-bit luma samples.  returns 1, with the two
+   bytes (parity and all) in pair, if the line carries caption data, or
+   0 if it doesn't. */
+int vbi_slice(const uint8_t* luma, int width, uint8_t pair[2]);
+
+/* the uncompressed video the slicer can be fed from */
+#define VBI_Y4M  0 /* YUV4MPEG2, 8 or 10 bits */
+#define VBI_UYVY 1 /* raw 8-bit 4:2:2, also known as 2vuy */
+#define VBI_V210 2 /* raw 10-bit 4:2:2, six pixels in every 16 bytes */
+
+typedef struct __vbi_struct vbi_t;
+
+/* read video in the given format from fd, which can be a pipe, and is
+   left open when the reader is freed.  raw frames are width x height;
+   a Y4M stream says its own size.  line 21 is looked for in the rows
+   near the top of the frame, and kept to once found.  memory use is
+   fixed. */
+vbi_t* vbi_new(int fd, int format, int width, int height);
+void vbi_free(vbi_t* vbi);
+
+/* read up to max consecutive frames' captions into bytes, four bytes a
+   frame as eia608_input takes them, and set *first to the frame number
+   of the first of them, counting from the start of the video.  frames
+   without caption data end a run; they are padding.  returns the number
+   of frames, 0 at the end of the video, or -1 on a read error. */
+long vbi_read(vbi_t* vbi, uint8_t* bytes, long max, long* first);
+
+/* what went wrong when vbi_read returned -1 */
+const char* vbi_error(vbi_t* vbi);
+
+/* the rows of the frame line 21 of each field was found on, -1 if not */
+void vbi_rows(vbi_t* vbi, int* field1, int* field2);
+
+#endif /* ndef __VBI_H */